@@ -9,11 +9,18 @@
 
 #include "MoiraConfig.h"
 #include "Moira.h"
+#include "MoiraSerialization.h"
+#ifdef MOIRA_BUS_HEADER
+#include MOIRA_BUS_HEADER
+#endif
 #include <cstdio>
+#include <cstring>
 #include <algorithm>
 #include <cmath>
 #include <bit>
 #include <vector>
+#include <optional>
+#include <stdexcept>
 
 namespace moira {
 
@@ -28,16 +35,18 @@ namespace moira {
 
 Moira::Moira()
 {
-    if (BUILD_INSTR_INFO_TABLE) info = new InstrInfo[65536];
-    if (ENABLE_DASM) dasm = new DasmPtr[65536];
+    preciseTiming = PRECISE_TIMING;
+    addressErrors = EMULATE_ADDRESS_ERROR;
+    functionCodes = EMULATE_FC;
     
     createJumpTable();
 }
 
 Moira::~Moira()
 {
-    if (info) delete [] info;
-    if (dasm) delete [] dasm;
+    delete [] opcodeHooks;
+    delete [] hookedExec;
+    delete [] hookedLoop;
 }
 
 void
@@ -51,6 +60,31 @@ Moira::setModel(Model model)
     }
 }
 
+void
+Moira::setPreciseTiming(bool value)
+{
+    preciseTiming = value && PRECISE_TIMING;
+}
+
+void
+Moira::setAddressErrors(bool value)
+{
+    addressErrors = value && EMULATE_ADDRESS_ERROR;
+}
+
+void
+Moira::setFunctionCodes(bool value)
+{
+    functionCodes = value && EMULATE_FC;
+}
+
+void
+Moira::setIdleDetection(bool value)
+{
+    idleDetection = value && DETECT_IDLE_LOOPS;
+    idleLoop.start = 0;
+}
+
 void
 Moira::setDasmStyle(DasmStyle value)
 {
@@ -112,6 +146,10 @@ Moira::reset()
     fcl = 0;
     fcSource = 0;
     
+#ifdef MOIRA_BUS
+    assert(dynamic_cast<MOIRA_BUS *>(this));
+#endif
+    
     SYNC(16);
     
     // Read the initial (supervisor) stack pointer from memory
@@ -131,6 +169,10 @@ Moira::reset()
     prefetch<C>();
     
     debugger.reset();
+    profiler.setEnabled(profiler.isEnabled());
+    sampler.setEnabled(sampler.isEnabled());
+    callGraph.setEnabled(callGraph.isEnabled());
+    coverage.setEnabled(coverage.isEnabled());
 }
 
 void
@@ -150,7 +192,7 @@ Moira::execute()
     if (!flags) {
         
         reg.pc += 2;
-        (this->*exec[queue.ird])(queue.ird);
+        (this->*execHandlers[exec[queue.ird]])(queue.ird);
         assert(reg.pc0 == reg.pc);
         return;
     }
@@ -159,10 +201,190 @@ Moira::execute()
     // The slow execution path: Process flags one by one
     //
     
+    executeSlowPath();
+}
+
+void
+Moira::execHooked(u16 opcode)
+{
+    [[maybe_unused]] auto [I, M, S] = info[opcode];
+    u8 mask = instrHooks[I] | (opcodeHooks ? opcodeHooks[opcode] : 0);
+    
+    // Skip the delegates which are already called by the handler itself
+    if (WILL_EXECUTE) mask &= ~HOOK_WILL_EXECUTE;
+    if (DID_EXECUTE) mask &= ~HOOK_DID_EXECUTE;
+    
+    u16 handler = (flags & CPU_IS_LOOPING) ? plainLoop[opcode] : plainExec[opcode];
+    
+    if (mask & HOOK_WILL_EXECUTE) willExecute(names[handler], I, M, S, opcode);
+    (this->*execHandlers[handler])(opcode);
+    if (mask & HOOK_DID_EXECUTE) didExecute(names[handler], I, M, S, opcode);
+}
+
+void
+Moira::hookInstr(Instr I, u8 mask)
+{
+    if constexpr (!BUILD_INSTR_INFO_TABLE) {
+        throw std::runtime_error("Instruction hooks require BUILD_INSTR_INFO_TABLE = true");
+    }
+    
+    instrHooks[I] = mask & (HOOK_WILL_EXECUTE | HOOK_DID_EXECUTE);
+    updateHooks();
+}
+
+void
+Moira::hookOpcode(u16 opcode, u8 mask)
+{
+    if constexpr (!BUILD_INSTR_INFO_TABLE) {
+        throw std::runtime_error("Instruction hooks require BUILD_INSTR_INFO_TABLE = true");
+    }
+    
+    if (!opcodeHooks) opcodeHooks = new u8[65536]();
+    opcodeHooks[opcode] = mask & (HOOK_WILL_EXECUTE | HOOK_DID_EXECUTE);
+    updateHooks();
+}
+
+void
+Moira::removeAllHooks()
+{
+    std::fill(std::begin(instrHooks), std::end(instrHooks), 0);
+    delete [] opcodeHooks;
+    opcodeHooks = nullptr;
+    updateHooks();
+}
+
+RunStats
+Moira::runUntil(i64 deadline)
+{
+    RunStats stats = { };
+    i64 start = clock;
+    
+    this->deadline = deadline;
+    
+    // Discard debug events from a previous run
+    flags &= ~CPU_DEBUG_EVENT;
+    
+    while (clock < deadline) {
+        
+        //
+        // The quick execution path: Run instructions until a flag is set
+        //
+        
+        if (blockCache.isEnabled()) {
+            
+            runCached(stats);
+            
+        } else {
+            
+            while (!flags && clock < deadline) {
+                
+                reg.pc += 2;
+                (this->*execHandlers[exec[queue.ird]])(queue.ird);
+                assert(reg.pc0 == reg.pc);
+                stats.instructions++;
+            }
+        }
+        
+        if (clock >= deadline) break;
+        
+        //
+        // The slow execution path: Process flags one by one
+        //
+        
+        // Leave early if the CPU is halted or a debug event has occurred
+        if (flags & (CPU_IS_HALTED | CPU_DEBUG_EVENT)) break;
+        
+        if (executeSlowPath()) stats.instructions++;
+    }
+    
+    this->deadline = INT64_MAX;
+    
+    stats.cycles = clock - start;
+    return stats;
+}
+
+void
+Moira::runCached(RunStats &stats)
+{
+    while (!flags && clock < deadline) {
+        
+        if (auto block = blockCache.lookup(reg.pc0)) {
+            
+            // Execute the cached instructions as long as they match
+            for (int i = 0; i < block->count; i++) {
+                
+                auto &entry = block->entries[i];
+                
+                if (entry.pc != reg.pc0 || entry.opcode != queue.ird) {
+                    
+                    // Record the block again if the first instruction has changed
+                    if (i == 0) block->count = 0;
+                    break;
+                }
+                
+                reg.pc += 2;
+                (this->*entry.handler)(entry.opcode);
+                assert(reg.pc0 == reg.pc);
+                stats.instructions++;
+                
+                if (flags || clock >= deadline) break;
+            }
+            
+        } else if (auto block = blockCache.create(reg.pc0)) {
+            
+            // Record a new block while executing it
+            u32 start = reg.pc0, pc;
+            
+            do {
+                
+                pc = reg.pc0;
+                auto handler = execHandlers[exec[queue.ird]];
+                block->entries[block->count++] = { handler, pc, queue.ird };
+                
+                reg.pc += 2;
+                (this->*handler)(queue.ird);
+                assert(reg.pc0 == reg.pc);
+                stats.instructions++;
+                
+            } while (!flags && clock < deadline &&
+                     block->count < BlockCache::blockSize && blockCache.extends(start, pc, reg.pc0));
+            
+        } else {
+            
+            // Execute an instruction outside of ROM
+            reg.pc += 2;
+            (this->*execHandlers[exec[queue.ird]])(queue.ird);
+            assert(reg.pc0 == reg.pc);
+            stats.instructions++;
+        }
+    }
+}
+
+bool
+Moira::executeSlowPath()
+{
+    bool executed = false;
+    
+    // Remember the upcoming instruction (needed by the profiler)
+    u32 pc = reg.pc0;
+    u16 opcode = queue.ird;
+    i64 start = clock;
+    
+    instrPC = pc;
+    instrIRD = opcode;
+    
+    // Clear the debug event flag of the previous instruction
+    flags &= ~CPU_DEBUG_EVENT;
+    
+    // If the execution history is recorded, inform the time machine
+    if (flags & CPU_RECORD) {
+        debugger.timeMachine.recordStep();
+    }
+    
     // Only continue if the CPU is not halted
     if (flags & CPU_IS_HALTED) {
-        sync(2);
-        return;
+        BUS(sync)(2);
+        return false;
     }
     
     // Process pending trace exception (if any)
@@ -186,40 +408,72 @@ Moira::execute()
         
         // Initiate a privilege exception if the supervisor bit is cleared
         if (!reg.sr.s) {
-            sync(4);
+            BUS(sync)(4);
             reg.pc -= 2;
             flags &= ~CPU_IS_STOPPED;
             execException(EXC_PRIVILEGE);
-            return;
+            return false;
         }
         
         pollIpl();
-        sync(MIMIC_MUSASHI ? 1 : 2);
-        return;
+        
+        // Fast-forward to the next cycle in which the IPL pins may change
+        if (fastForward && !(flags & (CPU_CHECK_IRQ | CPU_RECORD))) {
+            
+            i64 target = nextExternalChange();
+            
+            if (target > clock && target != INT64_MAX) {
+                
+                // Round up to the granularity of the polling loop
+                i64 step = MIMIC_MUSASHI ? 1 : 2;
+                i64 cycles = (target - clock + step - 1) / step * step;
+                BUS(sync)(int(std::min(cycles, i64(INT32_MAX - 1))));
+                return false;
+            }
+        }
+        
+        BUS(sync)(MIMIC_MUSASHI ? 1 : 2);
+        return false;
     }
     
-    // If logging is enabled, record the executed instruction
-    if (flags & CPU_LOG_INSTRUCTION) {
-        debugger.logInstruction();
+    // If logging is enabled, record the executed instruction (unless replayed)
+    if ((flags & (CPU_LOG_INSTRUCTION | CPU_LOG_TRACE | CPU_COVERAGE)) && isAnalyzing()) {
+        
+        if (flags & CPU_LOG_INSTRUCTION) {
+            debugger.logInstruction();
+        }
+        if (flags & CPU_LOG_TRACE) {
+            debugger.tracer.record();
+        }
+        if (flags & CPU_COVERAGE) {
+            coverage.record(reg.pc0, queue.ird);
+        }
     }
     
     // Execute the instruction
     if (flags & CPU_IS_LOOPING) {
         
         reg.pc += 2;
-        if (loop[queue.ird] == nullptr) {
+        if (loop[queue.ird] == NO_HANDLER) {
             printf("Callback missing\n");
+            flags |= CPU_DEBUG_EVENT;
             breakpointReached(reg.pc0);
         } else {
-            (this->*loop[queue.ird])(queue.ird);
+            (this->*execHandlers[loop[queue.ird]])(queue.ird);
             assert(reg.pc0 == reg.pc);
         }
     } else {
         
         reg.pc += 2;
-        (this->*exec[queue.ird])(queue.ird);
+        (this->*execHandlers[exec[queue.ird]])(queue.ird);
         assert(reg.pc0 == reg.pc);
     }
+    executed = true;
+    
+    // If profiling is enabled, record the executed instruction (unless replayed)
+    if ((flags & CPU_PROFILE) && isAnalyzing()) {
+        profiler.record(pc, opcode, clock - start);
+    }
     
 done:
     
@@ -227,14 +481,22 @@ done:
     if (flags & CPU_CHECK_BP) {
         
         // Don't break if the instruction won't be executed due to tracing
-        if (flags & CPU_TRACE_EXCEPTION) return;
+        if (flags & CPU_TRACE_EXCEPTION) return executed;
         
         // Check if a softstop has been reached
-        if (debugger.softstopMatches(reg.pc0)) softstopReached(reg.pc0);
+        if (debugger.softstopMatches(reg.pc0)) {
+            flags |= CPU_DEBUG_EVENT;
+            softstopReached(reg.pc0);
+        }
         
         // Check if a breakpoint has been reached
-        if (debugger.breakpointMatches(reg.pc0)) breakpointReached(reg.pc0);
+        if (debugger.breakpointMatches(reg.pc0)) {
+            flags |= CPU_DEBUG_EVENT;
+            breakpointReached(reg.pc0);
+        }
     }
+    
+    return executed;
 }
 
 bool
@@ -263,6 +525,250 @@ Moira::checkForIrq()
     }
 }
 
+i64
+Moira::nextExternalChange() const
+{
+    auto future = [&](i64 cycle) { return cycle > clock ? cycle : INT64_MAX; };
+    
+    // A deadline which has already passed is reported as is
+    return std::min({ deadline,
+                      future(scheduler.nextTrigger()),
+                      future(nextIplChange) });
+}
+
+void
+Moira::detectIdleLoop()
+{
+    auto &loop = idleLoop;
+    
+    // Compares all registers field by field (the structs contain padding bytes)
+    auto same = [](const Registers &r1, const Registers &r2) {
+        
+        return
+        r1.pc == r2.pc && r1.pc0 == r2.pc0 &&
+        r1.sr.t1 == r2.sr.t1 && r1.sr.t0 == r2.sr.t0 && r1.sr.s == r2.sr.s && r1.sr.m == r2.sr.m &&
+        r1.sr.x == r2.sr.x && r1.sr.n == r2.sr.n && r1.sr.z == r2.sr.z && r1.sr.v == r2.sr.v &&
+        r1.sr.c == r2.sr.c && r1.sr.ipl == r2.sr.ipl &&
+        std::equal(std::begin(r1.r), std::end(r1.r), std::begin(r2.r)) &&
+        r1.usp == r2.usp && r1.isp == r2.isp && r1.msp == r2.msp && r1.ipl == r2.ipl &&
+        r1.vbr == r2.vbr && r1.sfc == r2.sfc && r1.dfc == r2.dfc &&
+        r1.cacr == r2.cacr && r1.caar == r2.caar;
+    };
+    
+    // Check if the last iteration has left the CPU state untouched
+    bool idle =
+    loop.start == reg.pc0 &&
+    loop.writes == writes &&
+    loop.mappedReads == mappedReads &&
+    loop.change > clock &&
+    same(loop.reg, reg) &&
+    loop.queue.irc == queue.irc && loop.queue.ird == queue.ird &&
+    (loop.count == 0 || loop.cycles == clock - loop.clock);
+    
+    loop.count = idle ? loop.count + 1 : 0;
+    loop.cycles = clock - loop.clock;
+    
+    // Skip all iterations which end before the next external change
+    i64 change = nextExternalChange();
+    
+    if (loop.count >= 3 && loop.cycles > 0 && !flags && change != INT64_MAX) {
+        
+        i64 iterations = (change - clock - 1) / loop.cycles;
+        i64 cycles = std::min(iterations, i64(INT32_MAX) / loop.cycles) * loop.cycles;
+        if (cycles > 0) BUS(sync)(int(cycles));
+    }
+    
+    // Record the state at the end of this iteration
+    loop.start = reg.pc0;
+    loop.change = change;
+    loop.clock = clock;
+    loop.writes = writes;
+    loop.mappedReads = mappedReads;
+    loop.reg = reg;
+    loop.queue = queue;
+}
+
+void
+Moira::accelerateLoop(int dn)
+{
+    auto &loop = dbfLoop;
+    
+    // Measure the duration of the last iteration
+    bool same = loop.start == reg.pc0 && loop.cycles == clock - loop.clock;
+    loop.count = same ? loop.count + 1 : 0;
+    loop.cycles = clock - loop.clock;
+    loop.start = reg.pc0;
+    loop.clock = clock;
+    
+    if (loop.count < 1 || loop.cycles <= 0 || flags) return;
+    
+    // Determine the number of iterations to skip (the last one is executed)
+    u16 counter = (u16)reg.d[dn];
+    i64 iterations = i64(counter) - 1;
+    
+    i64 change = nextExternalChange();
+    if (change == INT64_MAX) return;
+    
+    iterations = std::min(iterations, (change - clock - 1) / loop.cycles);
+    iterations = std::min(iterations, i64(INT32_MAX) / loop.cycles);
+    if (iterations <= 0) return;
+    
+    // Locate the DBF instruction (the loop body is one or two words long)
+    u32 start = reg.pc0 & 0xFFFFFF, end = 0;
+    int count = 0;
+    
+    auto word = [&](u32 addr) -> std::optional<u16> {
+        
+        auto p = memoryMap.readPtr<Word>(addr & 0xFFFFFF);
+        if (p) return u16(p[0] << 8 | p[1]); else return { };
+    };
+    
+    for (int i = 1; i <= 2 && !count; i++) {
+        
+        u32 dbf = start + 2 * i;
+        auto op = word(dbf), disp = word(dbf + 2);
+        
+        if (op && disp && *op == (0x51C8 | dn) && *disp == u16(-2 * i - 2)) {
+            
+            count = i;
+            end = dbf + 4;
+        }
+    }
+    if (!count) return;
+    
+    // Decode the loop body
+    struct { int size; int src; int dst; bool fromD; bool clear; } ops[2];
+    
+    for (int i = 0; i < count; i++) {
+        
+        u16 op = *word(start + 2 * i);
+        auto &o = ops[i];
+        
+        if ((op & 0xC000) == 0 && (op & 0x3000) && (op & 0x01C0) == 0x00C0 &&
+            ((op & 0x0038) == 0x0018 || (op & 0x0038) == 0x0000)) {
+            
+            // MOVE (Ay)+,(Ax)+ or MOVE Dy,(Ax)+
+            o.size = (op & 0x3000) == 0x1000 ? 1 : (op & 0x3000) == 0x3000 ? 2 : 4;
+            o.src = op & 7;
+            o.dst = (op >> 9) & 7;
+            o.fromD = (op & 0x0038) == 0;
+            o.clear = false;
+            
+        } else if ((op & 0xFF38) == 0x4218 && (op & 0x00C0) != 0x00C0) {
+            
+            // CLR (Ax)+
+            o.size = 1 << ((op >> 6) & 3);
+            o.src = 0;
+            o.dst = op & 7;
+            o.fromD = false;
+            o.clear = true;
+            
+        } else {
+            return;
+        }
+        
+        // Byte accesses through A7 increment by two
+        if (o.size == 1 && (o.dst == 7 || (!o.fromD && !o.clear && o.src == 7))) return;
+    }
+    
+    // Returns the host memory location of an access (if it can be accelerated)
+    auto host = [&](u32 addr, int size, bool write) -> u8 * {
+        
+        addr &= 0xFFFFFF;
+        if (size > 1 && (addr & 1)) return nullptr;
+        
+        if (write) {
+            
+            // Don't overwrite the loop code
+            if (addr < end && addr + size > start) return nullptr;
+            
+            switch (size) {
+                case 1:  return memoryMap.writePtr<Byte>(addr);
+                case 2:  return memoryMap.writePtr<Word>(addr);
+                default: return memoryMap.writePtr<Long>(addr);
+            }
+        }
+        switch (size) {
+            case 1:  return const_cast<u8 *>(memoryMap.readPtr<Byte>(addr));
+            case 2:  return const_cast<u8 *>(memoryMap.readPtr<Word>(addr));
+            default: return const_cast<u8 *>(memoryMap.readPtr<Long>(addr));
+        }
+    };
+    
+    // Execute the loop directly on host memory
+    i64 done = 0;
+    
+    for (; done < iterations; done++) {
+        
+        u8 *src[2] = { }, *dst[2];
+        u32 a[8];
+        std::copy(std::begin(reg.a), std::end(reg.a), a);
+        
+        // Determine all host locations before modifying anything
+        for (int i = 0; i < count; i++) {
+            
+            auto &o = ops[i];
+            
+            if (!o.fromD && !o.clear) {
+                if (!(src[i] = host(a[o.src], o.size, false))) goto exit;
+                a[o.src] += o.size;
+            }
+            if (!(dst[i] = host(a[o.dst], o.size, true))) goto exit;
+            a[o.dst] += o.size;
+        }
+        
+        // Perform the data transfers
+        for (int i = 0; i < count; i++) {
+            
+            auto &o = ops[i];
+            u32 value = 0;
+            
+            if (o.fromD) {
+                value = reg.d[o.src];
+            } else if (!o.clear) {
+                for (int j = 0; j < o.size; j++) value = value << 8 | src[i][j];
+            }
+            for (int j = o.size - 1; j >= 0; j--, value >>= 8) dst[i][j] = u8(value);
+        }
+        writes += count;
+        
+        // Update the address registers and the loop counter
+        std::copy(std::begin(a), std::end(a), std::begin(reg.a));
+        writeD<Word>(dn, U32_SUB(readD<Word>(dn), 1));
+    }
+    
+exit:
+    
+    if (done) {
+        
+        BUS(sync)(int(done * loop.cycles));
+        loop.clock = clock;
+    }
+}
+
+u32
+Moira::inspect(u32 addr, Size S)
+{
+    addr &= 0xFFFFFF;
+    
+    switch (S) {
+            
+        case Byte:
+            
+            if (auto p = memoryMap.readPtr<Byte>(addr)) return p[0];
+            return (addr & 1) ? read16Dasm(addr & ~1) & 0xFF : read16Dasm(addr) >> 8;
+            
+        case Word:
+            
+            if (auto p = memoryMap.readPtr<Word>(addr)) return p[0] << 8 | p[1];
+            return read16Dasm(addr);
+            
+        default:
+            
+            return inspect(addr, Word) << 16 | inspect(addr + 2, Word);
+    }
+}
+
 void
 Moira::halt()
 {
@@ -274,6 +780,137 @@ Moira::halt()
     signalHalt();
 }
 
+template <class T> void
+Moira::serialize(T &worker)
+{
+    worker
+    
+    << serAs<u32>(flags)
+    << clock
+    
+    << reg.pc
+    << reg.pc0
+    << reg.sr.t1
+    << reg.sr.t0
+    << reg.sr.s
+    << reg.sr.m
+    << reg.sr.x
+    << reg.sr.n
+    << reg.sr.z
+    << reg.sr.v
+    << reg.sr.c
+    << reg.sr.ipl;
+    
+    for (auto &r : reg.r) worker << r;
+    
+    worker
+    
+    << reg.usp
+    << reg.isp
+    << reg.msp
+    << reg.ipl
+    << reg.vbr
+    << reg.sfc
+    << reg.dfc
+    << reg.cacr
+    << reg.caar
+    
+    << queue.irc
+    << queue.ird
+    
+    << ipl
+    << fcl
+    << fcSource
+    << serAs<i32>(exception)
+    << serAs<i32>(cp)
+    
+    << nextIplChange
+    << writes;
+
+    scheduler.serialize(worker);
+}
+
+u32
+Moira::stateSize() const
+{
+    u32 magic = 0, size = 0;
+    u16 version = 0;
+    u8 model = 0;
+    
+    SerCounter counter;
+    counter << magic << version << size << model;
+    const_cast<Moira *>(this)->serialize(counter);
+    
+    return counter.count;
+}
+
+u32
+Moira::saveState(std::span<u8> buffer) const
+{
+    u32 magic = stateMagic, size = stateSize();
+    u16 version = stateVersion;
+    u8 model = u8(this->model);
+    
+    if (buffer.size() < size) {
+        throw std::runtime_error("Buffer too small: " + std::to_string(buffer.size()));
+    }
+    
+    SerWriter writer(buffer.data());
+    writer << magic << version << size << model;
+    const_cast<Moira *>(this)->serialize(writer);
+    
+    return size;
+}
+
+void
+Moira::loadState(std::span<const u8> buffer)
+{
+    u32 magic = 0, size = 0;
+    u16 version = 0;
+    u8 model = 0;
+    
+    if (buffer.size() < sizeof(magic) + sizeof(version) + sizeof(size) + sizeof(model)) {
+        throw std::runtime_error("Buffer too small: " + std::to_string(buffer.size()));
+    }
+    
+    SerReader reader(buffer.data());
+    reader << magic << version << size << model;
+    
+    if (magic != stateMagic) {
+        throw std::runtime_error("Not a Moira snapshot");
+    }
+    if (version != stateVersion) {
+        throw std::runtime_error("Unsupported snapshot version: " + std::to_string(version));
+    }
+    if (size != stateSize() || buffer.size() < size) {
+        throw std::runtime_error("Invalid snapshot size: " + std::to_string(size) +
+                                 " (is the same number of scheduler events registered?)");
+    }
+    if (model > M68030) {
+        throw std::runtime_error("Invalid CPU model: " + std::to_string(model));
+    }
+    
+    // Keep the flags which are managed by the debugger
+    int debugFlags =
+    CPU_LOG_INSTRUCTION | CPU_CHECK_BP | CPU_CHECK_WP | CPU_CHECK_CP | CPU_RECORD | CPU_PROFILE |
+    CPU_SAMPLE | CPU_LOG_TRACE | CPU_COVERAGE;
+    int keep = flags & debugFlags;
+    
+    setModel(Model(model));
+    serialize(reader);
+    flags = (flags & ~debugFlags) | keep;
+    
+    // Forget about previously observed loops
+    idleLoop.start = 0;
+    dbfLoop.start = 0;
+    
+    // Forget about the shadow call stack
+    callGraph.setEnabled(callGraph.isEnabled());
+    
+    // Realign the sampling grid with the restored clock
+    sampler.setEnabled(sampler.isEnabled());
+}
+
 template <Size S> u32
 Moira::readD(int n) const
 {
@@ -415,14 +1052,14 @@ Moira::readFC() const
 void
 Moira::setFC(FunctionCode value)
 {
-    if (!EMULATE_FC) return;
+    if (!EMULATE_FC || !functionCodes) return;
     fcl = (u8)value;
 }
 
 template <Mode M> void
 Moira::setFC()
 {
-    if (!EMULATE_FC) return;
+    if (!EMULATE_FC || !functionCodes) return;
     fcl = (M == MODE_DIPC || M == MODE_IXPC) ? FC_USER_PROG : FC_USER_DATA;
 }
 
@@ -467,7 +1104,7 @@ Moira::disassemble(u32 addr, char *str, DasmStyle core)
     
     StrWriter writer(str, style, numberFormat);
     
-    (this->*dasm[opcode])(writer, pc, opcode);
+    (this->*dasmHandlers[plainExec[opcode]])(writer, pc, opcode);
     writer << Finish{};
     
     // Post process disassembler output
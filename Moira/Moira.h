@@ -11,6 +11,14 @@
 
 #include "MoiraTypes.h"
 #include "MoiraDebugger.h"
+#include "MoiraMemoryMap.h"
+#include "MoiraScheduler.h"
+#include "MoiraProfiler.h"
+#include "MoiraSampler.h"
+#include "MoiraCallGraph.h"
+#include "MoiraCoverage.h"
+#include "MoiraBlockCache.h"
+#include <span>
 
 namespace moira {
 
@@ -20,6 +28,14 @@ class Moira {
     friend class Breakpoints;
     friend class Watchpoints;
     friend class Catchpoints;
+    friend class TimeMachine;
+    friend class Tracer;
+    friend class Profiler;
+    friend class Sampler;
+    friend class CallGraph;
+    friend class Coverage;
+    friend class BlockCache;
+    friend class Condition;
     
     //
     // Sub components
@@ -30,6 +46,21 @@ public:
     // Breakpoints, watchpoints, catchpoints, instruction tracing
     Debugger debugger = Debugger(*this);
     
+    // Regions of the address space backed by host memory
+    MemoryMap memoryMap;
+    
+    // Events triggered at certain clock cycles
+    Scheduler scheduler;
+    
+    // Execution statistics
+    Profiler profiler = Profiler(*this);
+    Sampler sampler = Sampler(*this);
+    CallGraph callGraph = CallGraph(*this);
+    Coverage coverage = Coverage(*this);
+    
+    // Predecoded instructions in ROM
+    BlockCache blockCache = BlockCache(*this);
+    
     
     //
     // Internals
@@ -49,6 +80,11 @@ protected:
     DasmLetterCase letterCase = DASM_MIXED_CASE;
     Tab tab{8};
     
+    // Accuracy settings (only effective if compiled in via MoiraConfig.h)
+    bool preciseTiming = false;
+    bool addressErrors = false;
+    bool functionCodes = false;
+    
     /* State flags
      *
      * CPU_IS_HALTED:
@@ -84,8 +120,30 @@ protected:
      *
      * CPU_CHECK_WP:
      *    This flag indicates whether the CPU should check fo watchpoints.
+     *
+     * CPU_DEBUG_EVENT:
+     *    Set when a breakpoint, watchpoint, catchpoint, or software trap has
+     *    been reached. The flag causes run() to return early. It is cleared
+     *    when the next instruction is executed.
+     *
+     * CPU_RECORD:
+     *    This flag is set if the time machine records the execution history.
+     *
+     * CPU_PROFILE:
+     *    This flag is set if the profiler records execution statistics.
+     *
+     * CPU_SAMPLE:
+     *    This flag is set by the sampler shortly before a sample is taken. It
+     *    routes execution through the slow path, which records the start
+     *    address and the opcode of each instruction.
+     *
+     * CPU_LOG_TRACE:
+     *    This flag is set if the tracer records the executed instructions.
+     *
+     * CPU_COVERAGE:
+     *    This flag is set if the code coverage is recorded.
      */
-    int flags;
+    int flags = 0;
     static constexpr int CPU_IS_HALTED          = (1 << 8);
     static constexpr int CPU_IS_STOPPED         = (1 << 9);
     static constexpr int CPU_IS_LOOPING         = (1 << 10);
@@ -96,19 +154,75 @@ protected:
     static constexpr int CPU_CHECK_BP           = (1 << 15);
     static constexpr int CPU_CHECK_WP           = (1 << 16);
     static constexpr int CPU_CHECK_CP           = (1 << 17);
+    static constexpr int CPU_DEBUG_EVENT        = (1 << 18);
+    static constexpr int CPU_RECORD             = (1 << 19);
+    static constexpr int CPU_PROFILE            = (1 << 20);
+    static constexpr int CPU_SAMPLE             = (1 << 21);
+    static constexpr int CPU_LOG_TRACE          = (1 << 22);
+    static constexpr int CPU_COVERAGE           = (1 << 23);
     
     // Number of elapsed cycles since powerup
     i64 clock;
     
+    // The clock value at which the current call to runUntil() returns
+    i64 deadline = INT64_MAX;
+    
     // The egister set
     Registers reg;
     
     // The prefetch queue
     PrefetchQueue queue;
     
+    // Start address and opcode of the instruction being executed. Other than
+    // pc0 and ird, which advance when the next instruction is prefetched,
+    // these values stay valid until the instruction handler returns. They are
+    // only updated in the slow execution path.
+    u32 instrPC = 0;
+    u16 instrIRD = 0;
+    
     // Current value on the IPL pins (Interrupt Priority Level)
     u8 ipl;
     
+    // Fast-forward settings for the stopped state
+    bool fastForward = false;
+    i64 nextIplChange = INT64_MAX;
+    
+    // Number of performed write accesses
+    i64 writes = 0;
+    
+    // Set by the default implementations of poke8() and poke16()
+    bool pokeIgnored = false;
+    
+    // Number of data reads served by the memory map
+    i64 mappedReads = 0;
+    
+    // Idle loop detection
+    bool idleDetection = false;
+    struct {
+        
+        u32 start = 0;          // Start address of the loop
+        i64 clock = 0;          // Clock at the end of the previous iteration
+        i64 cycles = 0;         // Duration of the previous iteration
+        i64 writes = 0;         // Write counter at the end of the previous iteration
+        i64 mappedReads = 0;    // Mapped read counter at the end of the previous iteration
+        i64 change = 0;         // Next external change after the previous iteration
+        int count = 0;          // Number of identical iterations in a row
+        Registers reg;          // Registers at the end of the previous iteration
+        PrefetchQueue queue;    // Prefetch queue at the end of the previous iteration
+        
+    } idleLoop;
+    
+    // DBF loop acceleration
+    bool loopAcceleration = false;
+    struct {
+        
+        u32 start = 0;          // Start address of the loop
+        i64 clock = 0;          // Clock at the end of the previous iteration
+        i64 cycles = 0;         // Duration of the previous iteration
+        int count = 0;          // Number of equally long iterations in a row
+        
+    } dbfLoop;
+    
     // Value on the lower two function code pins (FC1|FC0)
     u8 fcl;
     
@@ -121,21 +235,73 @@ protected:
     // Cycle penalty (needed for 68020+ extended addressing modes)
     int cp;
     
-    // Jump table holding the instruction handlers
+    /* Jump tables
+     *
+     * The tables only depend on the emulated CPU model. They are generated at
+     * compile time and shared by all CPU instances. Each instance only stores
+     * pointers to the tables of the currently selected model.
+     *
+     * The opcode tables do not store the handler addresses directly. They
+     * store 16-bit handler ids which index a small table of member function
+     * pointers. Pointers have to be relocated by the dynamic loader if Moira
+     * is linked into a position independent executable. With one pointer per
+     * opcode, the loader would process about 800.000 relocations at each
+     * program start. With handler ids, only the handler tables are relocated.
+     */
     typedef void (Moira::*ExecPtr)(u16);
-    ExecPtr exec[65536];
+    typedef void (Moira::*DasmPtr)(StrWriter&, u32&, u16);
     
-    // Jump table holding the instruction handlers for the 68010 loop mode
-    ExecPtr loop[65536];
+    // Reserved handler ids
+    static constexpr u16 NO_HANDLER = 0;
+    static constexpr u16 HOOK_HANDLER = 1;
     
-    // Jump table holding the disassebler handlers
-    typedef void (Moira::*DasmPtr)(StrWriter&, u32&, u16);
-    DasmPtr *dasm = nullptr;
+    struct JumpTable {
+        
+        const ExecPtr *execHandlers = nullptr;
+        const DasmPtr *dasmHandlers = nullptr;
+        const char *const *names = nullptr;
+        const u16 *exec = nullptr;
+        const u16 *loop = nullptr;
+        const InstrInfo *info = nullptr;
+    };
+    
+    // Instruction handlers (indexed by handler id)
+    const ExecPtr *execHandlers = nullptr;
+    
+    // Disassembler handlers (indexed by handler id)
+    const DasmPtr *dasmHandlers = nullptr;
+    
+    // Jump table holding the handler ids of all opcodes
+    const u16 *exec = nullptr;
+    
+    // Jump table holding the unhooked handler ids of all opcodes
+    const u16 *plainExec = nullptr;
+    
+    // Jump table holding the handler ids for the 68010 loop mode
+    const u16 *loop = nullptr;
+    
+    // Jump table holding the unhooked handler ids for the 68010 loop mode
+    const u16 *plainLoop = nullptr;
     
 private:
     
     // Table holding instruction infos
-    InstrInfo *info = nullptr;
+    const InstrInfo *info = nullptr;
+    
+    // Table holding the names of the instruction handlers (indexed by handler id)
+    const char *const *names = nullptr;
+    
+    /* Instruction hooks
+     *
+     * Each mask is a combination of ExecHook values. If a hook is installed,
+     * the CPU uses private copies of the jump tables in which the handler ids
+     * of all hooked opcodes are replaced by execHooked(). Hence, instructions
+     * without a hook are executed at full speed.
+     */
+    u8 instrHooks[TST_LOOP + 1] = { };
+    u8 *opcodeHooks = nullptr;
+    u16 *hookedExec = nullptr;
+    u16 *hookedLoop = nullptr;
     
     
     //
@@ -147,9 +313,22 @@ public:
     Moira();
     virtual ~Moira();
     
+    // CPUs can't be copied, because the debugger refers to its parent CPU
+    Moira(const Moira &) = delete;
+    Moira& operator=(const Moira &) = delete;
+    
     // Selects the emulated CPU model
     void setModel(Model model);
     
+    // Configures the emulation accuracy (features which are not compiled in
+    // via MoiraConfig.h stay disabled)
+    bool getPreciseTiming() const { return preciseTiming; }
+    void setPreciseTiming(bool value);
+    bool getAddressErrors() const { return addressErrors; }
+    void setAddressErrors(bool value);
+    bool getFunctionCodes() const { return functionCodes; }
+    void setFunctionCodes(bool value);
+    
     // Configures the disassembler
     void setDasmStyle(DasmStyle value);
     void setDasmNumberFormat(DasmNumberFormat value);
@@ -158,12 +337,25 @@ public:
     
 protected:
     
-    // Creates the generic jump table
+    // Connects the jump tables of the selected CPU model
     void createJumpTable();
     
 private:
     
-    template <Core C> void createJumpTable();
+    // Returns the jump tables of a CPU model
+    static JumpTable getJumpTable(Model model);
+    
+    // Rebuilds the private jump table after the hooks have changed
+    void updateHooks();
+    
+    // Populates the jump tables of a CPU model (evaluated at compile time)
+    template <Core C> static constexpr void createJumpTable(Model model,
+                                                            ExecPtr *handlers,
+                                                            DasmPtr *dasm,
+                                                            const char **names,
+                                                            u16 *exec,
+                                                            u16 *loop,
+                                                            InstrInfo *info);
     
     
     //
@@ -178,6 +370,17 @@ public:
     // Executes the next instruction
     void execute();
     
+    /* Executes instructions in a loop
+     *
+     * run() executes instructions for the specified number of cycles and
+     * runUntil() executes instructions until the clock has reached the
+     * specified value. Both functions return early if the CPU is halted or a
+     * debug event has occurred. The returned statistics report the number of
+     * executed instructions and elapsed cycles.
+     */
+    RunStats run(i64 cycles) { return runUntil(clock + cycles); }
+    RunStats runUntil(i64 deadline);
+    
     // Returns true if the CPU is in HALT state
     bool isHalted() const { return flags & CPU_IS_HALTED; }
     
@@ -186,6 +389,44 @@ private:
     // Called by reset()
     template <Core C> void reset();
     
+    // Processes all flags and executes the next instruction (if any)
+    bool executeSlowPath();
+    
+    // Runs instructions through the block cache until a flag is set
+    void runCached(RunStats &stats);
+    
+    // Calls the instruction delegates around a hooked instruction handler
+    void execHooked(u16 opcode);
+    
+    // Checks if the analysis tools should record the current instruction
+    bool isAnalyzing() const { return !debugger.timeMachine.isReplaying(); }
+    
+    
+    //
+    // Hooking instructions
+    //
+    
+public:
+    
+    /* Installs willExecute() and didExecute() hooks at runtime
+     *
+     * The mask is a combination of ExecHook values and replaces the current
+     * mask of the instruction or opcode. An opcode is hooked if a hook is
+     * installed for the opcode itself or for its instruction. Runtime hooks
+     * complement the compile-time hooks selected by WILL_EXECUTE and
+     * DID_EXECUTE. A delegate is called once if both apply. The func argument
+     * holds the name of the instruction handler in both cases. In contrast to
+     * the compile-time hooks, didExecute() is also called if the instruction
+     * has been aborted by an exception. Instructions executed in the 68010
+     * loop mode are hooked, too. Requires BUILD_INSTR_INFO_TABLE to be
+     * enabled.
+     */
+    void hookInstr(Instr I, u8 mask);
+    void hookOpcode(u16 opcode, u8 mask);
+    u8 getInstrHook(Instr I) const { return instrHooks[I]; }
+    u8 getOpcodeHook(u16 opcode) const { return opcodeHooks ? opcodeHooks[opcode] : 0; }
+    void removeAllHooks();
+    
     // Invoked inside execute() to check for a pending interrupt
     bool checkForIrq();
     
@@ -193,6 +434,47 @@ private:
     void halt();
     
     
+    //
+    // Serializing
+    //
+    
+public:
+    
+    /* Saving and restoring the CPU state
+     *
+     * saveState() writes a snapshot of the CPU into the provided buffer and
+     * returns the number of written bytes. The snapshot has a fixed size which
+     * is reported by stateSize(). It starts with a header consisting of a
+     * magic number, the format version, the snapshot size, and the CPU model.
+     * All values are stored in little endian byte order. loadState() restores
+     * a snapshot and switches to the recorded CPU model. Both functions throw
+     * a std::runtime_error if the buffer is too small or if the snapshot has
+     * not been created by a compatible version. Otherwise, no memory is
+     * allocated.
+     *
+     * The snapshot covers the processor state and the trigger cycles of all
+     * scheduler events registered by the client. Event callbacks are not
+     * included. Events are matched in the order of their ids, i.e., the client
+     * has to register the same event sources in the same order before a
+     * snapshot is loaded. Internal events of Moira's own components are
+     * neither saved nor restored. Memory and the debugger setup (guards,
+     * software traps, the instruction log) are owned by the client and not
+     * included either. The flags controlling the debugger are
+     * kept as they are when a snapshot is loaded.
+     */
+    static constexpr u32 stateMagic = 0x52494F4D; // "MOIR"
+    static constexpr u16 stateVersion = 1;
+    
+    u32 stateSize() const;
+    u32 saveState(std::span<u8> buffer) const;
+    void loadState(std::span<const u8> buffer);
+    
+private:
+    
+    // Applies a serialization worker to all state variables
+    template <class T> void serialize(T &worker);
+    
+    
     //
     // Running the Disassembler
     //
@@ -230,14 +512,29 @@ protected:
     virtual u8 read8(u32 addr) = 0;
     virtual u16 read16(u32 addr) = 0;
     
+    // Reads a long word (used if neither precise timing nor address errors are active)
+    virtual u32 read32(u32 addr) {
+        return read16(addr) << 16 | read16((addr + 2) & 0xFFFFFF); }
+    
     // Special variants used by the reset routine and the disassembler
     virtual u16 read16OnReset(u32 addr) { return read16(addr); }
     virtual u16 read16Dasm(u32 addr) { return read16(addr); }
     
+    // Reads memory without side effects (mapped pages first, then read16Dasm())
+    u32 inspect(u32 addr, Size S);
+    
+    // Side-effect free writes used by the time machine (see TimeMachine)
+    virtual void poke8(u32 addr, u8 val) { pokeIgnored = true; }
+    virtual void poke16(u32 addr, u16 val) { pokeIgnored = true; }
+    
     // Writes a byte or word into memory
     virtual void write8(u32 addr, u8 val) = 0;
     virtual void write16(u32 addr, u16 val) = 0;
     
+    // Writes a long word (used if neither precise timing nor address errors are active)
+    virtual void write32(u32 addr, u32 val) {
+        write16(addr, u16(val >> 16)); write16((addr + 2) & 0xFFFFFF, u16(val)); }
+    
     // Provides the interrupt level in IRQ_USER mode
     virtual u16 readIrqUserVector(u8 level) const { return 0; }
     
@@ -277,8 +574,17 @@ public:
     
 protected:
     
-    // Advances the clock (called before each memory access)
-    virtual void sync(int cycles) { clock += cycles; }
+    /* Advances the clock (called before each memory access)
+     *
+     * Due events are served by the scheduler. Clients overriding this
+     * function need to call it from their implementation if the scheduler
+     * is used.
+     */
+    virtual void sync(int cycles) {
+        
+        clock += cycles;
+        if (scheduler.isDue(clock)) scheduler.serve(clock);
+    }
     
     
     //
@@ -392,8 +698,62 @@ public:
     u8 getIPL() const { return ipl; }
     void setIPL(u8 val);
     
+    /* Fast-forwarding through the stopped state
+     *
+     * If enabled, a stopped CPU advances the clock in a single step to the
+     * next cycle in which the IPL pins may change. This is the earliest of
+     * the next scheduler event, the cycle announced by announceIplChange(),
+     * and the end of the current run. If none of these cycles is known, the
+     * clock is advanced as usual. Only enable this option if the IPL pins are
+     * solely changed by scheduler events or at announced cycles.
+     */
+    void setFastForward(bool value) { fastForward = value; }
+    void announceIplChange(i64 cycle) { nextIplChange = cycle; }
+    
+    /* Skipping idle loops
+     *
+     * If enabled, Moira watches loops closed by a backward branch. If an
+     * iteration neither writes to memory nor changes the CPU state, all
+     * following iterations will be identical until the memory contents or
+     * the IPL pins change. After the loop has been confirmed a few times,
+     * the clock is advanced by as many whole iterations as fit in before the
+     * next cycle in which such a change may happen (see setFastForward()).
+     * The skipped instructions are not counted in the statistics returned by
+     * run(). Only enable this option if unmapped memory and the IPL pins are
+     * solely changed by scheduler events or at announced cycles.
+     *
+     * Only loops polling I/O registers are skipped. A loop which reads data
+     * from a page mapped in the memory map is never skipped, because host
+     * memory may be modified by other components at any time. Requires
+     * DETECT_IDLE_LOOPS to be enabled.
+     */
+    bool getIdleDetection() const { return idleDetection; }
+    void setIdleDetection(bool value);
+    
+    /* Accelerating DBF loops
+     *
+     * If enabled, Moira recognizes DBF loops whose body consists of one or
+     * two instructions of the form MOVE (Ay)+,(Ax)+, MOVE Dy,(Ax)+, or
+     * CLR (Ax)+. Once the duration of an iteration has been measured, the
+     * loop is executed directly on host memory, provided that all accessed
+     * pages are mapped in the memory map. The clock is advanced by the
+     * duration of the skipped iterations. The last iteration is always
+     * executed by the instruction handlers, which ensures that the flags
+     * come out right. The same restrictions as for setIdleDetection() apply.
+     */
+    void setLoopAcceleration(bool value) { loopAcceleration = value; dbfLoop.start = 0; }
+    
 private:
     
+    // Returns the next cycle in which the IPL pins or memory may change
+    i64 nextExternalChange() const;
+    
+    // Called at the end of a backward branch if idle loop detection is enabled
+    void detectIdleLoop();
+    
+    // Called at the end of a taken DBF if loop acceleration is enabled
+    void accelerateLoop(int dn);
+    
     // Polls the IPL pins
     void pollIpl() { reg.ipl = ipl; }
     
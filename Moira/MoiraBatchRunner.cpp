@@ -0,0 +1,208 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "MoiraBatchRunner.h"
+#include <algorithm>
+#include <chrono>
+
+namespace moira {
+
+BatchRunner::BatchRunner(int threads)
+{
+    threads = std::max(threads, 1);
+
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threads; i++) {
+        workers[i]->thread = std::thread(&BatchRunner::work, this, i);
+    }
+}
+
+BatchRunner::~BatchRunner()
+{
+    {   std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wakeup.notify_all();
+
+    for (auto &worker : workers) worker->thread.join();
+}
+
+int
+BatchRunner::add(std::unique_ptr<Moira> cpu)
+{
+    assert(cpu);
+
+    contexts.push_back(Context { .cpu = std::move(cpu) });
+    return (int)contexts.size() - 1;
+}
+
+BatchStats
+BatchRunner::run(i64 cycles, i64 slice)
+{
+    assert(slice > 0);
+
+    BatchStats stats = { };
+    auto start = std::chrono::steady_clock::now();
+
+    // Distribute the CPUs evenly among all workers
+    for (auto &worker : workers) {
+
+        worker->jobs.clear();
+        worker->instructions = 0;
+        worker->cycles = 0;
+        worker->busy = 0.0;
+    }
+    for (int i = 0; i < cpus(); i++) {
+
+        contexts[i].remaining = cycles;
+        workers[i % threads()]->jobs.push_back(i);
+    }
+
+    if (cycles > 0 && cpus() > 0) {
+
+        // Wake up the workers and wait until they are done
+        std::unique_lock<std::mutex> lock(mutex);
+
+        this->slice = slice;
+        pending = cpus();
+        active = threads();
+        generation++;
+
+        wakeup.notify_all();
+        finished.wait(lock, [&] { return active == 0; });
+    }
+
+    // Collect statistics
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto &worker : workers) {
+
+        stats.instructions += worker->instructions;
+        stats.cycles += worker->cycles;
+        stats.utilization.push_back(stats.seconds > 0 ? worker->busy / stats.seconds : 0.0);
+    }
+    stats.mips = stats.seconds > 0 ? stats.instructions / stats.seconds / 1000000.0 : 0.0;
+
+    return stats;
+}
+
+void
+BatchRunner::work(int nr)
+{
+    u64 seen = 0;
+
+    while (true) {
+
+        // Wait for the next batch
+        {   std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait(lock, [&] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+        }
+
+        process(nr);
+
+        // Report back
+        {   std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0) finished.notify_one();
+        }
+    }
+}
+
+void
+BatchRunner::process(int nr)
+{
+    auto &worker = *workers[nr];
+
+    while (pending > 0) {
+
+        u64 seen;
+        {   std::lock_guard<std::mutex> lock(queueMutex);
+            seen = requeued;
+        }
+
+        auto job = nextJob(nr);
+
+        if (!job) {
+
+            // All remaining CPUs are being executed by other workers
+            std::unique_lock<std::mutex> lock(queueMutex);
+            available.wait(lock, [&] { return pending == 0 || requeued != seen; });
+            continue;
+        }
+
+        auto &context = contexts[*job];
+        i64 cycles = std::min(context.remaining, slice);
+
+        auto start = std::chrono::steady_clock::now();
+        auto stats = context.cpu->run(cycles);
+        worker.busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        worker.instructions += stats.instructions;
+        worker.cycles += stats.cycles;
+        context.remaining -= stats.cycles;
+
+        // A CPU stays in the batch until it has finished or returned early
+        if (context.remaining > 0 && stats.cycles >= cycles) {
+
+            {   std::lock_guard<std::mutex> lock(worker.mutex);
+                worker.jobs.push_back(*job);
+            }
+            {   std::lock_guard<std::mutex> lock(queueMutex);
+                requeued++;
+            }
+            available.notify_one();
+
+        } else {
+
+            bool last;
+            {   std::lock_guard<std::mutex> lock(queueMutex);
+                last = --pending == 0;
+            }
+            if (last) available.notify_all();
+        }
+    }
+}
+
+std::optional<int>
+BatchRunner::nextJob(int nr)
+{
+    // Take the oldest job from the own queue
+    {   auto &worker = *workers[nr];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+
+        if (!worker.jobs.empty()) {
+
+            int job = worker.jobs.front();
+            worker.jobs.pop_front();
+            return job;
+        }
+    }
+
+    // Steal the newest job from another worker
+    for (int i = 1; i < threads(); i++) {
+
+        auto &victim = *workers[(nr + i) % threads()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.jobs.empty()) {
+
+            int job = victim.jobs.back();
+            victim.jobs.pop_back();
+            return job;
+        }
+    }
+
+    return { };
+}
+
+}
@@ -0,0 +1,157 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "Moira.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace moira {
+
+struct BatchStats {
+
+    i64 instructions;       // Number of executed instructions (all CPUs)
+    i64 cycles;             // Number of elapsed cycles (all CPUs)
+    double seconds;         // Elapsed wall clock time
+    double mips;            // Executed instructions per second (in millions)
+
+    // Fraction of the wall clock time each worker thread spent emulating
+    std::vector<double> utilization;
+};
+
+/* Batch runner
+ *
+ * The batch runner owns a set of independent CPUs and executes them in
+ * parallel on a pool of worker threads. run() splits the requested number of
+ * cycles into time slices. Each worker processes the CPUs in its own queue
+ * one slice at a time and steals CPUs from the other queues if its own queue
+ * runs empty. Workers which find no job sleep until a CPU is queued again or
+ * the batch is finished. A CPU leaves the batch early if it is halted or if a
+ * debug event has occurred.
+ *
+ * Distinct Moira instances share no mutable state. Hence, the CPUs can be
+ * executed concurrently, as long as the memory interface of each CPU only
+ * touches data owned by this CPU. A CPU may be executed by different threads
+ * in different slices, but never by two threads at the same time.
+ */
+class BatchRunner {
+
+    struct Context {
+
+        // The emulated CPU
+        std::unique_ptr<Moira> cpu;
+
+        // Number of cycles left in the current batch
+        i64 remaining = 0;
+    };
+
+    struct Worker {
+
+        // The thread processing the jobs
+        std::thread thread;
+
+        // Indices of the CPUs assigned to this worker
+        std::deque<int> jobs;
+        std::mutex mutex;
+
+        // Statistics of the current batch
+        i64 instructions = 0;
+        i64 cycles = 0;
+        double busy = 0.0;
+    };
+
+    // All CPUs of this batch
+    std::vector<Context> contexts;
+
+    // All worker threads
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // Synchronization between run() and the worker threads
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable finished;
+
+    // Incremented whenever a new batch is started
+    u64 generation = 0;
+
+    // Number of workers still processing the current batch
+    int active = 0;
+
+    // Number of CPUs which haven't finished the current batch
+    std::atomic<int> pending = 0;
+
+    // Wakes up idle workers when a job is queued or the batch is finished
+    std::mutex queueMutex;
+    std::condition_variable available;
+
+    // Incremented whenever a CPU is put back into a queue
+    u64 requeued = 0;
+
+    // Duration of a single time slice in cycles
+    i64 slice = 0;
+
+    // Set to true to terminate all worker threads
+    bool quit = false;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    BatchRunner(int threads = std::thread::hardware_concurrency());
+    ~BatchRunner();
+
+    BatchRunner(const BatchRunner &) = delete;
+    BatchRunner& operator=(const BatchRunner &) = delete;
+
+
+    //
+    // Managing CPUs
+    //
+
+    // Adds a CPU to the batch and returns its index
+    int add(std::unique_ptr<Moira> cpu);
+
+    // Returns the number of CPUs or worker threads
+    int cpus() const { return (int)contexts.size(); }
+    int threads() const { return (int)workers.size(); }
+
+    // Provides access to a CPU
+    Moira &cpu(int nr) { return *contexts[nr].cpu; }
+
+
+    //
+    // Running
+    //
+
+    // Advances all CPUs by the specified number of cycles
+    BatchStats run(i64 cycles, i64 slice = 10000);
+
+private:
+
+    // The main function of a worker thread
+    void work(int nr);
+
+    // Processes jobs until all CPUs have finished the current batch
+    void process(int nr);
+
+    // Takes a job from the own queue or steals one from another worker
+    std::optional<int> nextJob(int nr);
+};
+
+}
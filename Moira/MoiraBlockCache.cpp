@@ -0,0 +1,88 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "Moira.h"
+
+namespace moira {
+
+BlockCache::~BlockCache()
+{
+    delete [] blocks;
+}
+
+void
+BlockCache::setEnabled(bool value)
+{
+    enabled = value;
+
+    // Keep the memory, because the cache might be disabled inside run()
+    if (value && !blocks) blocks = new Block[slotCount]();
+    flush();
+}
+
+void
+BlockCache::flush()
+{
+    if (blocks) {
+        for (u32 i = 0; i < slotCount; i++) blocks[i].count = 0;
+    }
+    generation = moira.memoryMap.getGeneration();
+}
+
+long
+BlockCache::blockCount() const
+{
+    long result = 0;
+
+    if (blocks) {
+        for (u32 i = 0; i < slotCount; i++) result += blocks[i].count != 0;
+    }
+    return result;
+}
+
+int
+BlockCache::blockSizeAt(u32 addr) const
+{
+    if (!blocks) return 0;
+
+    auto &block = blocks[(addr >> 1) & (slotCount - 1)];
+    return block.count && block.entries[0].pc == addr ? block.count : 0;
+}
+
+BlockCache::Block *
+BlockCache::lookup(u32 pc)
+{
+    // Discard all blocks if the memory map has changed
+    if (generation != moira.memoryMap.getGeneration()) flush();
+
+    auto &block = blocks[(pc >> 1) & (slotCount - 1)];
+    return block.count && block.entries[0].pc == pc ? &block : nullptr;
+}
+
+BlockCache::Block *
+BlockCache::create(u32 pc)
+{
+    // Only cache code in ROM
+    u32 addr = pc & 0xFFFFFF;
+    if (!moira.memoryMap.readPtr<Word>(addr) || moira.memoryMap.writePtr<Word>(addr)) return nullptr;
+
+    auto &block = blocks[(pc >> 1) & (slotCount - 1)];
+    block.count = 0;
+    return &block;
+}
+
+bool
+BlockCache::extends(u32 start, u32 prev, u32 pc) const
+{
+    // The instruction must follow its predecessor inside the same page
+    return pc > prev && pc - prev <= maxInstrSize && (pc ^ start) >> MemoryMap::pageBits == 0;
+}
+
+}
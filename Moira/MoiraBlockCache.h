@@ -0,0 +1,136 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+
+namespace moira {
+
+class Moira;
+
+/* Basic block cache
+ *
+ * The block cache speeds up the execution of code residing in ROM. It stores
+ * straight-line runs of instructions (blocks) together with the pre-resolved
+ * handler of each instruction. While the CPU executes a cached block, run()
+ * calls the stored handlers directly instead of looking them up in the jump
+ * tables.
+ *
+ * A block is recorded while the CPU executes it for the first time. Only
+ * code in pages which are mapped read-only in the memory map (ROM) is cached.
+ * A block ends at the end of its page, if the maximum number of instructions
+ * is reached, or if the program counter doesn't move forward by at most one
+ * instruction (e.g., if a branch has been taken or an exception has
+ * occurred). Before a cached instruction is executed, its address and opcode
+ * are compared with the program counter and the prefetch queue. If either
+ * one differs, the CPU leaves the block. Hence, a stale block never executes
+ * a wrong handler. All blocks are discarded if the memory map, the CPU model,
+ * or the instruction hooks change.
+ *
+ * The cache only replaces the jump table lookup. Extension words and the
+ * next opcode are still read by the handlers through the prefetch queue.
+ * Hence, bus accesses and timing are the same with and without the cache.
+ * The cache is only used by run() while no CPU flag is set. The cache memory
+ * is allocated on first use.
+ */
+class BlockCache {
+
+    friend class Moira;
+
+    // Pointer to an instruction handler
+    typedef void (Moira::*Handler)(u16);
+
+    // Maximum number of instructions per block
+    static constexpr int blockSize = 16;
+
+    // Number of cache slots (blocks are indexed by their start address)
+    static constexpr u32 slotCount = 1024;
+
+    // Maximum size of an instruction in bytes
+    static constexpr u32 maxInstrSize = 22;
+
+    struct Entry {
+
+        Handler handler;
+        u32 pc;
+        u16 opcode;
+    };
+
+    struct Block {
+
+        // Number of stored instructions (0 if the slot is empty)
+        int count;
+
+        // The cached instructions (the first one determines the start address)
+        Entry entries[blockSize];
+    };
+
+    // Reference to the connected CPU
+    class Moira &moira;
+
+    // The cache slots (nullptr if not allocated)
+    Block *blocks = nullptr;
+
+    // Indicates if the cache is used
+    bool enabled = false;
+
+    // Memory map generation the cached blocks are based on
+    u64 generation = 0;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    BlockCache(Moira& ref) : moira(ref) { }
+    ~BlockCache();
+
+
+    //
+    // Configuring
+    //
+
+    bool isEnabled() const { return enabled; }
+    void setEnabled(bool value);
+
+    // Discards all cached blocks
+    void flush();
+
+
+    //
+    // Inspecting
+    //
+
+    // Returns the number of cached blocks
+    long blockCount() const;
+
+    // Returns the number of instructions in the block starting at addr
+    int blockSizeAt(u32 addr) const;
+
+
+    //
+    // Executing (called by the CPU)
+    //
+
+private:
+
+    // Returns the block starting at the specified address (if cached)
+    Block *lookup(u32 pc);
+
+    // Returns an empty block for the specified address (if it can be cached)
+    Block *create(u32 pc);
+
+    // Checks if the specified address can be added to a block started at 'start'
+    bool extends(u32 start, u32 prev, u32 pc) const;
+};
+
+}
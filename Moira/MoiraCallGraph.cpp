@@ -0,0 +1,235 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "Moira.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace moira {
+
+void
+CallGraph::setEnabled(bool value)
+{
+    if (enabled) charge();
+
+    enabled = value;
+
+    // Start over with an empty shadow stack
+    frames.resize(1);
+    lastClock = moira.clock;
+}
+
+void
+CallGraph::clear()
+{
+    nodes.clear();
+    children.clear();
+    frames.clear();
+
+    // The root node represents the code that is executed outside any known function
+    nodes.push_back(Node { .addr = 0, .vector = 0, .parent = 0, .calls = 0, .self = 0 });
+    frames.push_back(Frame { .node = 0, .sp = 0, .stack = 0xFF });
+
+    unmatched = 0;
+    discarded = 0;
+    if (enabled) lastClock = moira.clock;
+}
+
+u8
+CallGraph::activeStack() const
+{
+    return moira.reg.sr.s ? (moira.reg.sr.m ? 2 : 1) : 0;
+}
+
+u32
+CallGraph::stackPointer(u8 stack) const
+{
+    auto &reg = moira.reg;
+
+    if (stack == activeStack()) return reg.sp;
+    return stack == 0 ? reg.usp : stack == 1 ? reg.isp : reg.msp;
+}
+
+void
+CallGraph::enter(u32 addr, u16 vector)
+{
+    u32 sp = moira.reg.sp;
+    u8 stack = activeStack();
+
+    charge();
+
+    // Discard all frames that have been left without a return
+    while (frames.size() > 1) {
+
+        auto &top = frames.back();
+
+        /* A frame is still active as long as its return address hasn't been
+         * popped. For the active stack, the new stack pointer is compared,
+         * which points below the just pushed return address or stack frame.
+         */
+        bool left = top.stack == stack ? top.sp <= sp : top.sp < stackPointer(top.stack);
+        if (!left) break;
+
+        frames.pop_back();
+        discarded++;
+    }
+
+    // Ignore the call if the shadow stack is full (its return won't match)
+    if (frames.size() >= maxDepth) return;
+
+    // Look up the node of the call path
+    u32 parent = frames.back().node;
+    u64 key = u64(parent) << 32 | u64(vector) << 24 | (addr & 0xFFFFFF);
+
+    auto [it, inserted] = children.try_emplace(key, u32(nodes.size()));
+    if (inserted) {
+        nodes.push_back(Node { .addr = addr & 0xFFFFFF, .vector = vector, .parent = parent, .calls = 0, .self = 0 });
+    }
+
+    nodes[it->second].calls++;
+    frames.push_back(Frame { .node = it->second, .sp = sp, .stack = stack });
+}
+
+void
+CallGraph::ret(u32 sp, u8 stack)
+{
+    // Search the frame belonging to this return
+    for (size_t i = frames.size() - 1; i > 0; i--) {
+
+        if (frames[i].sp == sp && frames[i].stack == stack) {
+
+            charge();
+            discarded += i64(frames.size() - i - 1);
+            frames.resize(i);
+            return;
+        }
+    }
+
+    unmatched++;
+}
+
+void
+CallGraph::charge()
+{
+    nodes[frames.back().node].self += moira.clock - lastClock;
+    lastClock = moira.clock;
+}
+
+std::vector<i64>
+CallGraph::selfCycles() const
+{
+    std::vector<i64> result(nodes.size());
+
+    for (size_t i = 0; i < nodes.size(); i++) result[i] = nodes[i].self;
+    if (enabled) result[frames.back().node] += moira.clock - lastClock;
+
+    return result;
+}
+
+std::vector<FunctionStats>
+CallGraph::functions(size_t count) const
+{
+    auto self = selfCycles();
+
+    // Accumulate the inclusive cycles (children are stored behind their parents)
+    std::vector<i64> total = self;
+    for (size_t i = nodes.size() - 1; i > 0; i--) total[nodes[i].parent] += total[i];
+
+    // Combine all nodes referring to the same function
+    std::unordered_map<u32, FunctionStats> table;
+
+    for (u32 i = 1; i < nodes.size(); i++) {
+
+        auto &node = nodes[i];
+        auto &entry = table[u32(node.vector) << 24 | node.addr];
+
+        entry.addr = node.addr;
+        entry.vector = node.vector;
+        entry.calls += node.calls;
+        entry.self += self[i];
+
+        // Only count the outermost activation of recursive functions
+        bool recursive = false;
+        for (u32 p = node.parent; p != 0 && !recursive; p = nodes[p].parent) {
+            recursive = nodes[p].addr == node.addr && nodes[p].vector == node.vector;
+        }
+        if (!recursive) entry.total += total[i];
+    }
+
+    std::vector<FunctionStats> result;
+    for (auto &it : table) result.push_back(it.second);
+
+    std::sort(result.begin(), result.end(), [](const FunctionStats &a, const FunctionStats &b) {
+        return a.total != b.total ? a.total > b.total : a.addr < b.addr;
+    });
+
+    if (result.size() > count) result.resize(count);
+    return result;
+}
+
+void
+CallGraph::dumpFolded(std::ostream &os) const
+{
+    auto self = selfCycles();
+
+    // Build the call paths (parents are stored in front of their children)
+    std::vector<std::string> paths(nodes.size());
+    paths[0] = name(0);
+    for (u32 i = 1; i < nodes.size(); i++) paths[i] = paths[nodes[i].parent] + ";" + name(i);
+
+    for (u32 i = 0; i < nodes.size(); i++) {
+        if (self[i]) os << paths[i] << " " << self[i] << "\n";
+    }
+}
+
+void
+CallGraph::dump(std::ostream &os, size_t count) const
+{
+    char line[128];
+
+    i64 total = 0;
+    for (auto cycles : selfCycles()) total += cycles;
+
+    auto percent = [&](i64 cycles) { return total ? 100.0 * double(cycles) / double(total) : 0.0; };
+
+    os << "Function          Calls      Exclusive      Inclusive\n";
+
+    for (auto &entry : functions(count)) {
+
+        if (entry.vector) {
+            snprintf(line, sizeof(line), "%06X (%3d) ", entry.addr, entry.vector);
+        } else {
+            snprintf(line, sizeof(line), "%06X       ", entry.addr);
+        }
+        os << line;
+
+        snprintf(line, sizeof(line), "%10lld %14lld %14lld %6.2f%%\n",
+                 entry.calls, entry.self, entry.total, percent(entry.total));
+        os << line;
+    }
+}
+
+std::string
+CallGraph::name(u32 node) const
+{
+    char buffer[32];
+
+    if (node == 0) {
+        return "root";
+    }
+    if (nodes[node].vector) {
+        snprintf(buffer, sizeof(buffer), "vec%d_%06X", nodes[node].vector, nodes[node].addr);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%06X", nodes[node].addr);
+    }
+    return buffer;
+}
+
+}
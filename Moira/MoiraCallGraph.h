@@ -0,0 +1,187 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace moira {
+
+struct FunctionStats {
+
+    u32 addr;               // Entry point of the function or exception handler
+    u16 vector;             // Exception vector (0 for subroutines)
+    i64 calls;              // Number of invocations
+    i64 self;               // Cycles spent in the function itself (exclusive)
+    i64 total;              // Cycles spent in the function and its callees (inclusive)
+};
+
+/* Call-graph profiler
+ *
+ * If enabled, the call graph maintains a shadow call stack which is updated
+ * by JSR, BSR, RTS, RTD, RTR, RTE, and by the exception entry code. Each frame
+ * stores the stack pointer as it has been seen by the callee together with the
+ * stack (USP, ISP, or MSP) that has been active. A return only pops the frame
+ * with a matching stack and stack pointer. All frames above it are discarded,
+ * which covers routines that leave via an exception or a stack manipulation.
+ * Returns without a matching frame (e.g., RTS used as an indirect jump) are
+ * ignored. A call or an exception discards all frames that have been left
+ * without a return, i.e., frames whose return address has already been
+ * removed from the stack they have been pushed on.
+ *
+ * The elapsed cycles are charged to the topmost frame each time the stack
+ * changes. The cycles of a call instruction are charged to the caller and the
+ * cycles of a return instruction to the callee. The graph is accumulated in a
+ * call tree that is keyed by the call path. It does not need the slow
+ * execution path and only costs a single check per call or return if disabled.
+ * Switching between tasks that run on different user stacks is not detected.
+ * Frames of a suspended task remain on the shadow stack until they are
+ * discarded by one of the rules above.
+ */
+class CallGraph {
+
+    // Reference to the connected CPU
+    class Moira &moira;
+
+    // Node of the call tree
+    struct Node {
+
+        u32 addr;           // Entry point
+        u16 vector;         // Exception vector (0 for subroutine calls)
+        u32 parent;         // Index of the parent node
+        i64 calls;          // Number of invocations
+        i64 self;           // Exclusive cycles
+    };
+
+    // Frame of the shadow call stack
+    struct Frame {
+
+        u32 node;           // Associated node of the call tree
+        u32 sp;             // Stack pointer right after the call
+        u8 stack;           // Active stack (0 = USP, 1 = ISP, 2 = MSP)
+    };
+
+    // Maximum depth of the shadow stack
+    static constexpr size_t maxDepth = 1024;
+
+    // The call tree (the root node comes first)
+    std::vector<Node> nodes;
+
+    // Lookup table for child nodes (parent << 32 | vector << 24 | address)
+    std::unordered_map<u64, u32> children;
+
+    // The shadow call stack
+    std::vector<Frame> frames;
+
+    // Cycle in which the topmost frame was last charged
+    i64 lastClock = 0;
+
+    // Number of returns without a matching frame
+    i64 unmatched = 0;
+
+    // Number of frames that have been left without a return
+    i64 discarded = 0;
+
+    // Indicates if recording is enabled
+    bool enabled = false;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    CallGraph(Moira& ref) : moira(ref) { clear(); }
+
+
+    //
+    // Configuring
+    //
+
+    // Starts or stops recording (the recorded data is kept)
+    bool isEnabled() const { return enabled; }
+    void setEnabled(bool value);
+
+    // Deletes all recorded data
+    void clear();
+
+
+    //
+    // Recording (called by the CPU)
+    //
+
+    // Called after a subroutine has been entered
+    void call(u32 addr) { enter(addr, 0); }
+
+    // Called after an exception handler has been entered
+    void exception(int nr, u32 addr) { enter(addr, u16(nr)); }
+
+    // Called after a return (sp is the stack pointer right after the matching call)
+    void ret(u32 sp, u8 stack);
+
+    // Returns the active stack (0 = USP, 1 = ISP, 2 = MSP)
+    u8 activeStack() const;
+
+
+    //
+    // Analyzing the recorded data
+    //
+
+    // Returns the number of returns without a matching call
+    i64 getUnmatched() const { return unmatched; }
+
+    // Returns the number of frames that have been left without a return
+    i64 getDiscarded() const { return discarded; }
+
+    // Returns the current depth of the shadow call stack
+    size_t depth() const { return frames.size(); }
+
+    /* Returns per-function statistics sorted by the inclusive cycle count
+     *
+     * Call paths ending in the same function are combined. The inclusive
+     * count of a recursive function only includes the outermost activation.
+     * At most 'count' entries are returned.
+     */
+    std::vector<FunctionStats> functions(size_t count = SIZE_MAX) const;
+
+    /* Writes the call tree in the folded-stack format
+     *
+     * Each line lists a call path, starting at the root, followed by the
+     * exclusive cycle count of the last function. The output can be processed
+     * by flame-graph tools such as flamegraph.pl or speedscope.
+     */
+    void dumpFolded(std::ostream &os) const;
+
+    // Prints the functions with the highest inclusive cycle counts
+    void dump(std::ostream &os, size_t count = 20) const;
+
+private:
+
+    // Pushes a new frame
+    void enter(u32 addr, u16 vector);
+
+    // Returns the current value of the specified stack pointer
+    u32 stackPointer(u8 stack) const;
+
+    // Charges the elapsed cycles to the topmost frame
+    void charge();
+
+    // Returns the exclusive cycle counts including the uncharged cycles
+    std::vector<i64> selfCycles() const;
+
+    // Returns the name of a node as it appears in the folded output
+    std::string name(u32 node) const;
+};
+
+}
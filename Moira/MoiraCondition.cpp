@@ -0,0 +1,373 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "Moira.h"
+#include "MoiraMacros.h"
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace moira {
+
+Condition::Condition(Moira& ref, const std::string &expr) : moira(ref), source(expr)
+{
+    skip();
+    parseBinary(0);
+
+    if (pos < source.size()) error("Unexpected '" + source.substr(pos, 1) + "'");
+}
+
+bool
+Condition::eval(i64 hits) const
+{
+    auto &reg = moira.reg;
+
+    i64 stack[maxDepth];
+    int sp = -1;
+
+    for (auto &op : code) {
+
+        switch (op.code) {
+
+            case PUSH:  stack[++sp] = op.value; break;
+            case REG:   stack[++sp] = reg.r[op.value]; break;
+            case SR:    stack[++sp] = moira.getSR(); break;
+            case CCR:   stack[++sp] = moira.getCCR(); break;
+            case USP:   stack[++sp] = moira.getUSP(); break;
+            case PC:    stack[++sp] = reg.pc0; break;
+            case HITS:  stack[++sp] = hits; break;
+
+            case FLAG:
+
+                switch (op.value) {
+
+                    case 0:  stack[++sp] = reg.sr.x; break;
+                    case 1:  stack[++sp] = reg.sr.n; break;
+                    case 2:  stack[++sp] = reg.sr.z; break;
+                    case 3:  stack[++sp] = reg.sr.v; break;
+                    case 4:  stack[++sp] = reg.sr.c; break;
+                    default: stack[++sp] = reg.sr.s; break;
+                }
+                break;
+
+            case MEM8:
+            case MEM16:
+            case MEM32: stack[sp] = read(u32(stack[sp]), op.code); break;
+
+            case NEG:   stack[sp] = -stack[sp]; break;
+            case NOT:   stack[sp] = !stack[sp]; break;
+            case INV:   stack[sp] = ~stack[sp]; break;
+
+            default:
+
+                sp--;
+                stack[sp] = apply(op.code, stack[sp], stack[sp + 1]);
+                break;
+        }
+    }
+
+    return stack[0] != 0;
+}
+
+i64
+Condition::apply(Opcode op, i64 a, i64 b)
+{
+    switch (op) {
+
+        case MUL:   return i64(u64(a) * u64(b));
+        case DIV:   return b && !(a == INT64_MIN && b == -1) ? a / b : 0;
+        case MOD:   return b && !(a == INT64_MIN && b == -1) ? a % b : 0;
+        case ADD:   return i64(u64(a) + u64(b));
+        case SUB:   return i64(u64(a) - u64(b));
+        case SHL:   return i64(u64(a) << (b & 63));
+        case SHR:   return a >> (b & 63);
+        case LT:    return a < b;
+        case LE:    return a <= b;
+        case GT:    return a > b;
+        case GE:    return a >= b;
+        case EQ:    return a == b;
+        case NE:    return a != b;
+        case AND:   return a & b;
+        case XOR:   return a ^ b;
+        case OR:    return a | b;
+        case LAND:  return a && b;
+        case LOR:   return a || b;
+
+        default:
+            fatalError;
+    }
+}
+
+i64
+Condition::read(u32 addr, Opcode op) const
+{
+    switch (op) {
+
+        case MEM8:  return moira.inspect(addr, Byte);
+        case MEM16: return moira.inspect(addr, Word);
+
+        default:
+            return moira.inspect(addr, Long);
+    }
+}
+
+void
+Condition::parseBinary(int level)
+{
+    // Binary operators, ordered by increasing precedence
+    static constexpr struct { int level; const char *token; Opcode op; } operators[] = {
+
+        { 0, "||", LOR }, { 1, "&&", LAND }, { 2, "|", OR }, { 3, "^", XOR }, { 4, "&", AND },
+        { 5, "==", EQ }, { 5, "!=", NE },
+        { 6, "<=", LE }, { 6, ">=", GE }, { 6, "<", LT }, { 6, ">", GT },
+        { 7, "<<", SHL }, { 7, ">>", SHR },
+        { 8, "+", ADD }, { 8, "-", SUB },
+        { 9, "*", MUL }, { 9, "/", DIV }, { 9, "%", MOD }
+    };
+
+    if (level > 9) { parseUnary(); return; }
+
+    parseBinary(level + 1);
+
+    for (bool found = true; found;) {
+
+        found = false;
+        for (auto &it : operators) {
+
+            if (it.level == level && accept(it.token)) {
+
+                parseBinary(level + 1);
+                emit(it.op);
+                found = true;
+                break;
+            }
+        }
+    }
+}
+
+void
+Condition::parseUnary()
+{
+    if (accept("-")) { parseUnary(); emit(NEG); return; }
+    if (accept("!")) { parseUnary(); emit(NOT); return; }
+    if (accept("~")) { parseUnary(); emit(INV); return; }
+    if (accept("+")) { parseUnary(); return; }
+
+    parsePrimary();
+}
+
+void
+Condition::parsePrimary()
+{
+    auto memory = [&](int size) {
+        emit(size == 1 ? MEM8 : size == 4 ? MEM32 : MEM16);
+    };
+
+    if (pos >= source.size()) error("Unexpected end of expression");
+
+    char c = source[pos];
+
+    // Parenthesized expressions and memory accesses
+    if (accept("(")) {
+
+        size_t start = code.size();
+        parseBinary(0);
+        if (!accept(")")) error("Missing ')'");
+
+        // A single address register denotes an indirect memory access
+        bool indirect = code.size() == start + 1 && code.back().code == REG && code.back().value >= 8;
+        int size = parseSuffix();
+
+        if (indirect || size) memory(size);
+        return;
+    }
+
+    // Numbers and displacements
+    if (isdigit(c) || c == '$') {
+
+        int base = 10;
+        if (c == '$') { base = 16; pos++; }
+        else if (source.compare(pos, 2, "0x") == 0 || source.compare(pos, 2, "0X") == 0) { base = 16; pos += 2; }
+
+        size_t digits = 0;
+        u64 value = 0;
+        for (; pos < source.size() && isxdigit(source[pos]); pos++, digits++) {
+
+            int digit = isdigit(source[pos]) ? source[pos] - '0' : (toupper(source[pos]) - 'A' + 10);
+            if (digit >= base) error("Invalid digit '" + source.substr(pos, 1) + "'");
+            value = value * base + u64(digit);
+        }
+        if (!digits) error("Missing digits");
+
+        emit(PUSH, i64(value));
+        skip();
+
+        if (accept("(")) {
+
+            parseBinary(0);
+            if (!accept(")")) error("Missing ')'");
+            emit(ADD);
+            memory(parseSuffix());
+        }
+        return;
+    }
+
+    // Registers, flags, and counters
+    if (isalpha(c)) {
+
+        size_t start = pos;
+        std::string name;
+        for (; pos < source.size() && isalnum(source[pos]); pos++) name += char(toupper(source[pos]));
+
+        if (name.size() == 2 && (name[0] == 'D' || name[0] == 'A') && name[1] >= '0' && name[1] <= '7') {
+            emit(REG, (name[0] == 'A' ? 8 : 0) + (name[1] - '0'));
+        } else if (name == "SP") {
+            emit(REG, 15);
+        } else if (name == "PC") {
+            emit(PC);
+        } else if (name == "SR") {
+            emit(SR);
+        } else if (name == "CCR") {
+            emit(CCR);
+        } else if (name == "USP") {
+            emit(USP);
+        } else if (name == "HITS") {
+            emit(HITS);
+            skip();
+            return;
+        } else if (name.size() == 1 && strchr("XNZVCS", name[0])) {
+            emit(FLAG, strchr("XNZVCS", name[0]) - "XNZVCS");
+            skip();
+            return;
+        } else {
+            pos = start;
+            error("Unknown identifier '" + name + "'");
+        }
+
+        // Registers may select their lower bits
+        skip();
+        if (int size = parseSuffix(); size && size < 4) {
+
+            emit(PUSH, size == 1 ? 0xFF : 0xFFFF);
+            emit(AND);
+        }
+        return;
+    }
+
+    error("Unexpected '" + source.substr(pos, 1) + "'");
+}
+
+int
+Condition::parseSuffix()
+{
+    if (pos + 1 < source.size() && source[pos] == '.') {
+
+        int size;
+        switch (toupper(source[pos + 1])) {
+
+            case 'B': size = 1; break;
+            case 'W': size = 2; break;
+            case 'L': size = 4; break;
+
+            default:
+                error("Invalid size suffix");
+        }
+
+        if (pos + 2 < source.size() && isalnum(source[pos + 2])) error("Invalid size suffix");
+
+        pos += 2;
+        skip();
+        return size;
+    }
+    return 0;
+}
+
+bool
+Condition::accept(const char *token)
+{
+    size_t len = strlen(token);
+
+    if (source.compare(pos, len, token) != 0) return false;
+
+    // Don't split two-character operators (e.g., '|' must not match "||")
+    if (len == 1 && pos + 1 < source.size()) {
+
+        char next = source[pos + 1];
+        if (strchr("|&<>", token[0]) && next == token[0]) return false;
+        if (strchr("<>!", token[0]) && next == '=') return false;
+    }
+
+    pos += len;
+    skip();
+    return true;
+}
+
+void
+Condition::skip()
+{
+    while (pos < source.size() && isspace(source[pos])) pos++;
+}
+
+void
+Condition::emit(Opcode op, i64 value)
+{
+    auto isConst = [&](size_t back) {
+        return code.size() >= back && code[code.size() - back].code == PUSH;
+    };
+
+    switch (op) {
+
+        case PUSH: case REG: case SR: case CCR: case USP: case PC: case FLAG: case HITS:
+
+            if (++depth > maxDepth) error("Expression too complex");
+            code.push_back(Op { op, value });
+            break;
+
+        case MEM8: case MEM16: case MEM32:
+
+            code.push_back(Op { op, value });
+            break;
+
+        case NEG: case NOT: case INV:
+
+            // Fold constants
+            if (isConst(1)) {
+
+                auto &arg = code.back().value;
+                arg = op == NEG ? i64(0 - u64(arg)) : op == NOT ? !arg : ~arg;
+                break;
+            }
+            code.push_back(Op { op, value });
+            break;
+
+        default:
+
+            depth--;
+
+            // Fold constants
+            if (isConst(1) && isConst(2)) {
+
+                i64 b = code.back().value;
+                code.pop_back();
+                code.back().value = apply(op, code.back().value, b);
+                break;
+            }
+            code.push_back(Op { op, value });
+            break;
+    }
+}
+
+void
+Condition::error(const std::string &msg) const
+{
+    throw std::runtime_error("Condition '" + source + "', position " + std::to_string(pos) + ": " + msg);
+}
+
+}
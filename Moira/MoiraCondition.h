@@ -0,0 +1,135 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+#include <string>
+#include <vector>
+
+namespace moira {
+
+/* Guard condition
+ *
+ * A condition is a C-like expression that is attached to a breakpoint,
+ * watchpoint, or catchpoint. It is parsed once and compiled into the bytecode
+ * of a small stack machine, which is executed each time the guard's address
+ * matches. The guard only triggers if the expression evaluates to a non-zero
+ * value. All values are 64-bit signed integers. Registers are zero-extended.
+ *
+ *     Numbers:    123, 0x7F, $7F
+ *     Registers:  D0 ... D7, A0 ... A7, SP, PC, SR, CCR, USP
+ *                 An optional suffix (.b, .w, .l) selects the lower bits
+ *     Flags:      X, N, Z, V, C (condition codes), S (supervisor mode)
+ *     Counters:   HITS (number of matches including the current one)
+ *     Memory:     (An), d(An), (expr).b, (expr).w, (expr).l
+ *                 (An) and d(An) read a word unless a suffix is given,
+ *                 d is a number (use (An - d).w for negative offsets)
+ *     Operators:  Unary - ! ~, binary * / % + - << >> < <= > >= == != & ^ |
+ *                 && ||, with the same precedence as in C
+ *
+ * Example: "D0 == 0x1234 && (A0) > 16"
+ *
+ * A parenthesized expression is a memory access if it consists of a single
+ * address register or if a size suffix follows. Otherwise, it groups a
+ * subexpression. Memory is read like the CPU sees it (mapped pages first,
+ * then read16Dasm() to avoid side effects). Addresses are truncated to 24 bits.
+ * Both operands of && and || are always evaluated. Division by zero yields 0.
+ * Syntax errors are reported by throwing a std::runtime_error.
+ */
+class Condition {
+
+    // Reference to the connected CPU
+    class Moira &moira;
+
+    enum Opcode : u8 {
+
+        PUSH, REG, SR, CCR, USP, PC, FLAG, HITS, MEM8, MEM16, MEM32,
+        NEG, NOT, INV,
+        MUL, DIV, MOD, ADD, SUB, SHL, SHR,
+        LT, LE, GT, GE, EQ, NE, AND, XOR, OR, LAND, LOR
+    };
+
+    struct Op {
+
+        Opcode code;
+        i64 value;
+    };
+
+    // Maximum depth of the evaluation stack
+    static constexpr int maxDepth = 32;
+
+    // The original expression
+    std::string source;
+
+    // The compiled expression
+    std::vector<Op> code;
+
+    // Parser state
+    size_t pos = 0;
+    int depth = 0;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    // Compiles an expression (throws a std::runtime_error on syntax errors)
+    Condition(Moira& ref, const std::string &expr);
+
+
+    //
+    // Evaluating
+    //
+
+public:
+
+    const std::string &getSource() const { return source; }
+
+    // Returns true if the expression evaluates to a non-zero value
+    bool eval(i64 hits) const;
+
+private:
+
+    // Applies a binary operator
+    static i64 apply(Opcode op, i64 a, i64 b);
+
+    // Reads a byte, word, or long word from memory
+    i64 read(u32 addr, Opcode op) const;
+
+
+    //
+    // Parsing
+    //
+
+    // Parses a binary expression at the specified precedence level
+    void parseBinary(int level);
+
+    // Parses unary operators and primary expressions
+    void parseUnary();
+    void parsePrimary();
+
+    // Parses an optional size suffix (returns the size in bytes or 0)
+    int parseSuffix();
+
+    // Checks for the specified operator and skips it
+    bool accept(const char *token);
+
+    // Skips white space
+    void skip();
+
+    // Appends an instruction to the compiled code
+    void emit(Opcode op, i64 value = 0);
+
+    [[noreturn]] void error(const std::string &msg) const;
+};
+
+}
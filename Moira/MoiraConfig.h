@@ -17,32 +17,70 @@
  * emulate the surrounding hardware up the point where the memory access
  * actually happens.
  *
+ * This option compiles precise timing mode in. It is used by all CPUs which
+ * have not been switched to fast timing by calling setPreciseTiming(false).
+ * The mode is checked at runtime. Hence, CPUs using fast timing run slower
+ * if this option is enabled (see PROFILE_TIMING in the test runner).
+ *
  * Enable to improve accuracy, disable to gain speed.
  */
+#ifndef PRECISE_TIMING
 #define PRECISE_TIMING false
+#endif
 
 /* Set to true to enable address error checking.
  *
  * The 68000 and 68010 signal an address error violation if an odd memory
  * location is accessed in combination with word or long word addressing.
+ * If compiled in, address error checking can be switched off at runtime by
+ * calling setAddressErrors(false).
  *
  * Enable to improve accuracy, disable to gain speed.
  */
+#ifndef EMULATE_ADDRESS_ERROR
 #define EMULATE_ADDRESS_ERROR false
+#endif
 
 /* Set to true to emulate the function code pins FC0 - FC2.
  *
  * Whenever memory is accessed, the function code pins enable external hardware
  * to inspect the access type. If used, these pins are usually connected to an
- * external memory management unit (MMU).
+ * external memory management unit (MMU). If compiled in, the emulation can be
+ * switched off at runtime by calling setFunctionCodes(false).
  *
  * Enable to improve accuracy, disable to gain speed.
  */
 #define EMULATE_FC true
 
+/* Set to true to enable the memory map.
+ *
+ * If enabled, each memory access is looked up in the memory map and mapped
+ * pages are accessed directly (see MemoryMap). If disabled, the lookup is
+ * omitted, all accesses are passed to the virtual read and write functions,
+ * and mapping a region has no effect.
+ *
+ * Disable to gain speed if the memory map is not used.
+ */
+#ifndef ENABLE_MEMORY_MAP
+#define ENABLE_MEMORY_MAP true
+#endif
+
+/* Set to true to enable idle loop detection.
+ *
+ * Idle loop detection counts all write accesses and all data reads served by
+ * the memory map. If compiled in, it can be switched on at runtime by calling
+ * setIdleDetection(true). Otherwise, the counters are omitted and the
+ * detection stays disabled.
+ *
+ * Enable to speed up programs which wait in polling loops.
+ */
+#ifndef DETECT_IDLE_LOOPS
+#define DETECT_IDLE_LOOPS false
+#endif
+
 /* Set to true to enable the disassembler.
  *
- * The disassembler requires a jump table which consumes about 1MB of memory.
+ * The disassembler requires an additional handler table for each CPU model.
  * Disabling the disassembler will decrease the memory footprint.
  */
 #define ENABLE_DASM true
@@ -68,6 +106,11 @@
 
 /* The following macro appear at the beginning of each instruction handler.
  * Moira will call 'willExecute(...)' for all listed instructions.
+ *
+ * The macros bind the instruction delegates at compile time. Additional
+ * hooks can be installed at runtime via Moira::hookInstr() and
+ * Moira::hookOpcode(), which doesn't require a rebuild and leaves all other
+ * instructions untouched.
  */
 #define WILL_EXECUTE    I == STOP || I == TAS || I == BKPT
 
@@ -76,6 +119,22 @@
  */
 #define DID_EXECUTE     I == RESET
 
+/* Uncomment to bind the memory interface statically.
+ *
+ * By default, Moira accesses memory and advances the clock by calling the
+ * virtual functions read8, read16, write8, write16, and sync. If the class
+ * embedding Moira is known at compile time, its name and the header declaring
+ * it can be specified here. In this case, Moira calls the functions of this
+ * class directly, which enables the compiler to inline them into the
+ * instruction handlers. All instantiated CPUs must be of the specified type
+ * and the class has to declare Moira as a friend if the functions are not
+ * public.
+ *
+ * Enable to gain speed.
+ */
+// #define MOIRA_BUS        TestCPU
+// #define MOIRA_BUS_HEADER "TestCPU.h"
+
 /* Comment out to enable assertion checking.
  *
  * Uncomment in release builds, comment out in debug builds.
@@ -0,0 +1,142 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "Moira.h"
+#include <algorithm>
+
+namespace moira {
+
+//
+// CoverageMap
+//
+
+size_t
+CoverageMap::pcCount() const
+{
+    return pcEntries - std::count(pcs.begin(), pcs.end(), 0);
+}
+
+size_t
+CoverageMap::opcodeCount() const
+{
+    return opcodeEntries - std::count(opcodes.begin(), opcodes.end(), 0);
+}
+
+std::vector<u32>
+CoverageMap::addresses() const
+{
+    std::vector<u32> result;
+
+    for (size_t i = 0; i < pcEntries; i++) {
+        if (pcs[i]) result.push_back(u32(i) << 1);
+    }
+    return result;
+}
+
+void
+CoverageMap::clear()
+{
+    std::fill(pcs.begin(), pcs.end(), 0);
+    std::fill(opcodes.begin(), opcodes.end(), 0);
+}
+
+void
+CoverageMap::merge(const CoverageMap &other)
+{
+    for (size_t i = 0; i < pcEntries; i++) pcs[i] |= other.pcs[i];
+    for (size_t i = 0; i < opcodeEntries; i++) opcodes[i] |= other.opcodes[i];
+}
+
+void
+CoverageMap::diff(const CoverageMap &base, CoverageMap &result) const
+{
+    for (size_t i = 0; i < pcEntries; i++) result.pcs[i] = pcs[i] && !base.pcs[i];
+    for (size_t i = 0; i < opcodeEntries; i++) result.opcodes[i] = opcodes[i] && !base.opcodes[i];
+}
+
+bool
+CoverageMap::hasNew(const CoverageMap &base) const
+{
+    u8 any = 0;
+
+    for (size_t i = 0; i < pcEntries; i++) any |= pcs[i] & ~base.pcs[i];
+    for (size_t i = 0; i < opcodeEntries; i++) any |= opcodes[i] & ~base.opcodes[i];
+
+    return any != 0;
+}
+
+
+//
+// Coverage
+//
+
+void
+Coverage::setEnabled(bool value)
+{
+    enabled = value;
+
+    if (value) {
+
+        allocate();
+        moira.flags |= Moira::CPU_COVERAGE;
+
+    } else {
+
+        moira.flags &= ~Moira::CPU_COVERAGE;
+    }
+}
+
+void
+Coverage::clear()
+{
+    if (live) live->clear();
+}
+
+CoverageMap
+Coverage::snapshot() const
+{
+    return live ? *live : CoverageMap { };
+}
+
+void
+Coverage::merge(const CoverageMap &map)
+{
+    allocate();
+    live->merge(map);
+}
+
+void
+Coverage::diff(const CoverageMap &base, CoverageMap &result) const
+{
+    if (live) {
+        live->diff(base, result);
+    } else {
+        result.clear();
+    }
+}
+
+bool
+Coverage::hasNew(const CoverageMap &base) const
+{
+    return live && live->hasNew(base);
+}
+
+void
+Coverage::allocate()
+{
+    if (!live) {
+
+        live = std::make_unique<CoverageMap>();
+        pcs = live->pcs.data();
+        opcodes = live->opcodes.data();
+    }
+}
+
+}
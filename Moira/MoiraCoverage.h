@@ -0,0 +1,154 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+#include <memory>
+#include <vector>
+
+namespace moira {
+
+/* Coverage map
+ *
+ * A coverage map stores one byte for each instruction address and one byte
+ * for each opcode. A byte is nonzero if the address or opcode has been
+ * covered. Using bytes instead of bits turns recording into a plain store
+ * without reading the map first. Instructions are word-aligned. Hence, the
+ * address map covers the 24-bit address space with 2^23 bytes (8 MB). Maps
+ * are plain values which can be stored, merged, and compared, e.g., to check
+ * if a fuzzing input has reached new code.
+ */
+struct CoverageMap {
+
+    static constexpr size_t pcEntries = 1 << 23;
+    static constexpr size_t opcodeEntries = 1 << 16;
+
+    // Map indexed by the instruction address divided by 2
+    std::vector<u8> pcs = std::vector<u8>(pcEntries);
+
+    // Map indexed by the opcode
+    std::vector<u8> opcodes = std::vector<u8>(opcodeEntries);
+
+
+    //
+    // Querying
+    //
+
+    bool coversPC(u32 addr) const { return pcs[(addr & 0xFFFFFF) >> 1]; }
+    bool coversOpcode(u16 opcode) const { return opcodes[opcode]; }
+
+    // Returns the number of covered addresses or opcodes
+    size_t pcCount() const;
+    size_t opcodeCount() const;
+
+    // Returns all covered instruction addresses in ascending order
+    std::vector<u32> addresses() const;
+
+
+    //
+    // Modifying
+    //
+
+    // Marks an instruction address and an opcode as covered
+    void record(u32 pc, u16 opcode) { pcs[(pc & 0xFFFFFF) >> 1] = 1; opcodes[opcode] = 1; }
+
+    // Marks everything as uncovered
+    void clear();
+
+
+    //
+    // Combining
+    //
+
+    // Adds all entries of another map
+    void merge(const CoverageMap &other);
+
+    // Stores the entries which are set in this map, but not in 'base', in 'result'
+    void diff(const CoverageMap &base, CoverageMap &result) const;
+
+    // Checks if this map contains an entry which is not set in 'base'
+    bool hasNew(const CoverageMap &base) const;
+};
+
+/* Code coverage recorder
+ *
+ * If enabled, the coverage recorder marks each executed instruction address
+ * and opcode in a live coverage map. Enabling the recorder sets a CPU flag
+ * which routes all instructions through the slow execution path. Hence, the
+ * recorder causes no overhead if disabled. The live map is allocated on first
+ * use.
+ */
+class Coverage {
+
+    // Reference to the connected CPU
+    class Moira &moira;
+
+    // The live map (nullptr if not allocated)
+    std::unique_ptr<CoverageMap> live;
+
+    // Cached pointers into the live map
+    u8 *pcs = nullptr;
+    u8 *opcodes = nullptr;
+
+    // Indicates if recording is enabled
+    bool enabled = false;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    Coverage(Moira& ref) : moira(ref) { }
+
+
+    //
+    // Configuring
+    //
+
+    // Starts or stops recording (the recorded data is kept)
+    bool isEnabled() const { return enabled; }
+    void setEnabled(bool value);
+
+    // Deletes all recorded data
+    void clear();
+
+
+    //
+    // Recording (called by the CPU)
+    //
+
+    void record(u32 pc, u16 opcode) { pcs[(pc & 0xFFFFFF) >> 1] = 1; opcodes[opcode] = 1; }
+
+
+    //
+    // Analyzing the recorded data
+    //
+
+    // Returns a copy of the live map
+    CoverageMap snapshot() const;
+
+    // Adds the entries of a previously taken snapshot
+    void merge(const CoverageMap &map);
+
+    // Stores the entries which have been recorded, but are not set in 'base', in 'result'
+    void diff(const CoverageMap &base, CoverageMap &result) const;
+
+    // Checks if an instruction or opcode has been recorded which is not in 'base'
+    bool hasNew(const CoverageMap &base) const;
+
+private:
+
+    // Allocates the live map if necessary
+    void allocate();
+};
+
+}
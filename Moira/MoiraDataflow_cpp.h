@@ -352,27 +352,39 @@ Moira::readMS(u32 addr)
     
     if constexpr (S == Long) {
         
-        // Break down the long word access into two word accesses
-        result = readMS<C, MS, Word>(addr) << 16;
-        result |= readMS<C, MS, Word, F>(addr + 2);
-        
-    } else {
-        
-        // Update function code pins
-        setFC(MS == MEM_DATA ? FC_USER_DATA : FC_USER_PROG);
-        
-        // Check if a watchpoint is being accessed
-        if ((flags & CPU_CHECK_WP) && debugger.watchpointMatches(addr, S)) {
-            watchpointReached(addr);
+        // Break down the long word access into two word accesses if needed
+        if (SPLIT_LONG) {
+            
+            result = readMS<C, MS, Word>(addr) << 16;
+            result |= readMS<C, MS, Word, F>(addr + 2);
+            return result;
         }
-        
-        // Perform the read operation
-        SYNC(2);
-        if (F & POLLIPL) pollIpl();
-        result = (S == Byte) ? read8(addr & 0xFFFFFF) : read16(addr & 0xFFFFFF);
-        SYNC(2);
     }
     
+    // Update function code pins
+    setFC(MS == MEM_DATA ? FC_USER_DATA : FC_USER_PROG);
+    
+    // Check if a watchpoint is being accessed
+    if ((flags & CPU_CHECK_WP) && debugger.watchpointMatches(addr, S, false)) {
+        flags |= CPU_DEBUG_EVENT;
+        watchpointReached(addr);
+    }
+    
+    // Perform the read operation
+    SYNC(2);
+    if (F & POLLIPL) pollIpl();
+    if (auto p = ENABLE_MEMORY_MAP ? memoryMap.readPtr<S>(addr & 0xFFFFFF) : nullptr) {
+        if constexpr (DETECT_IDLE_LOOPS && MS == MEM_DATA) mappedReads++;
+        result =
+        S == Byte ? p[0] :
+        S == Word ? u32(p[0] << 8 | p[1]) : u32(p[0]) << 24 | u32(p[1] << 16 | p[2] << 8 | p[3]);
+    } else {
+        result =
+        S == Byte ? BUS(read8)(addr & 0xFFFFFF) :
+        S == Word ? BUS(read16)(addr & 0xFFFFFF) : BUS(read32)(addr & 0xFFFFFF);
+    }
+    SYNC(2);
+    
     return result;
 }
 
@@ -414,31 +426,47 @@ Moira::writeMS(u32 addr, u32 val)
 {
     if constexpr (S == Long) {
         
-        // Break down the long word access into two word accesses
-        if (F & REVERSE) {
-            writeMS<C, MS, Word>   (addr + 2, val & 0xFFFF);
-            writeMS<C, MS, Word, F>(addr,     val >> 16   );
-        } else {
-            writeMS<C, MS, Word>   (addr,     val >> 16   );
-            writeMS<C, MS, Word, F>(addr + 2, val & 0xFFFF);
+        // Break down the long word access into two word accesses if needed
+        if ((F & REVERSE) || SPLIT_LONG) {
+            
+            if (F & REVERSE) {
+                writeMS<C, MS, Word>   (addr + 2, val & 0xFFFF);
+                writeMS<C, MS, Word, F>(addr,     val >> 16   );
+            } else {
+                writeMS<C, MS, Word>   (addr,     val >> 16   );
+                writeMS<C, MS, Word, F>(addr + 2, val & 0xFFFF);
+            }
+            return;
         }
+    }
+    
+    // Update function code pins
+    setFC(MS == MEM_DATA ? FC_USER_DATA : FC_USER_PROG);
+    
+    // Check for watchpoints and record the old value if the history is recorded
+    if (flags & (CPU_CHECK_WP | CPU_RECORD)) {
         
-    } else {
-        
-        // Update function code pins
-        setFC(MS == MEM_DATA ? FC_USER_DATA : FC_USER_PROG);
-        
-        // Check if a watchpoint is being accessed
-        if ((flags & CPU_CHECK_WP) && debugger.watchpointMatches(addr, S)) {
+        if ((flags & CPU_CHECK_WP) && debugger.watchpointMatches(addr, S, true)) {
+            flags |= CPU_DEBUG_EVENT;
             watchpointReached(addr);
         }
-        
-        // Perform the write operation
-        SYNC(2);
-        if (F & POLLIPL) pollIpl();
-        S == Byte ? write8(addr & 0xFFFFFF, (u8)val) : write16(addr & 0xFFFFFF, (u16)val);
-        SYNC(2);
+        if (flags & CPU_RECORD) debugger.timeMachine.recordWrite(addr, S);
+    }
+    
+    // Perform the write operation
+    SYNC(2);
+    if (F & POLLIPL) pollIpl();
+    if constexpr (DETECT_IDLE_LOOPS) writes++;
+    if (auto p = ENABLE_MEMORY_MAP ? memoryMap.writePtr<S>(addr & 0xFFFFFF) : nullptr) {
+        for (int i = 0; i < S; i++) p[i] = u8(val >> (8 * (S - 1 - i)));
+    } else if constexpr (S == Byte) {
+        BUS(write8)(addr & 0xFFFFFF, (u8)val);
+    } else if constexpr (S == Word) {
+        BUS(write16)(addr & 0xFFFFFF, (u16)val);
+    } else {
+        BUS(write32)(addr & 0xFFFFFF, val);
     }
+    SYNC(2);
 }
 
 template <Core C, Size S> u32
@@ -493,7 +521,7 @@ template <Core C, Size S> bool
 Moira::misaligned(u32 addr)
 {
     if constexpr (EMULATE_ADDRESS_ERROR && C != C68020 && S != Byte) {
-        return addr & 1;
+        return addressErrors && (addr & 1);
     } else {
         return false;
     }
@@ -630,8 +658,13 @@ Moira::jumpToVector(int nr)
     SYNC(2);
     prefetch<C, POLLIPL>();
     
+    if (callGraph.isEnabled() && isAnalyzing()) callGraph.exception(nr, reg.pc);
+    
     // Stop emulation if the exception should be catched
-    if (debugger.catchpointMatches(nr)) catchpointReached(u8(nr));
+    if (debugger.catchpointMatches(nr)) {
+        flags |= CPU_DEBUG_EVENT;
+        catchpointReached(u8(nr));
+    }
     
     signalJumpToVector(nr, reg.pc);
 }
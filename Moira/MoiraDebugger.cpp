@@ -12,6 +12,7 @@
 #include "MoiraMacros.h"
 #include <cstring>
 #include <cstdio>
+#include <algorithm>
 
 namespace moira {
 
@@ -24,6 +25,28 @@ Guard::eval(u32 addr, Size S)
 {
     if (this->addr >= addr && this->addr < addr + u32(S) && this->enabled) {
         
+        hits++;
+        if (condition && !condition->eval(hits)) return false;
+        
+        if (!ignore) return true;
+        ignore--;
+    }
+    return false;
+}
+
+
+//
+// WatchRange
+//
+
+bool
+WatchRange::eval(bool isWrite)
+{
+    if (enabled && (isWrite ? write : read)) {
+        
+        hits++;
+        if (condition && !condition->eval(hits)) return false;
+        
         if (!ignore) return true;
         ignore--;
     }
@@ -50,11 +73,8 @@ Guards::guardNr(long nr)const
 Guard *
 Guards::guardAt(u32 addr) const
 {
-    for (int i = 0; i < count; i++) {
-        if (guards[i].addr == addr) return &guards[i];
-    }
-    
-    return nullptr;
+    auto it = lookup.find(addr);
+    return it != lookup.end() ? &guards[it->second] : nullptr;
 }
 
 std::optional<u32>
@@ -78,7 +98,8 @@ Guards::setAt(u32 addr)
         capacity *= 2;
     }
     
-    guards[count++].addr = addr;
+    guards[count++] = Guard { .addr = addr };
+    index(count - 1);
     setNeedsCheck(true);
 }
 
@@ -91,24 +112,45 @@ Guards::remove(long nr)
 void
 Guards::removeAt(u32 addr)
 {
-    for (int i = 0; i < count; i++) {
+    if (auto it = lookup.find(addr); it != lookup.end()) {
+        
+        long nr = it->second;
+        unindex(nr);
         
-        if (guards[i].addr == addr) {
+        // Close the gap and update the positions of the moved guards
+        for (long j = nr; j + 1 < count; j++) {
             
-            for (int j = i; j + 1 < count; j++) guards[j] = guards[j + 1];
-            count--;
-            break;
+            guards[j] = std::move(guards[j + 1]);
+            lookup[guards[j].addr] = j;
         }
+        
+        // Reset the vacated slot
+        guards[--count] = Guard { };
     }
     setNeedsCheck(count != 0);
 }
 
+void
+Guards::removeAll()
+{
+    for (long i = 0; i < count; i++) guards[i] = Guard { };
+    count = 0;
+    
+    lookup.clear();
+    pageRefs.clear();
+    pages.reset();
+    
+    setNeedsCheck(false);
+}
+
 void
 Guards::replace(long nr, u32 addr)
 {
     if (nr >= count || isSetAt(addr)) return;
     
+    unindex(nr);
     guards[nr].addr = addr;
+    index(nr);
 }
 
 bool
@@ -160,20 +202,112 @@ Guards::ignore(long nr, long count)
     if (guard) guard->ignore = count;
 }
 
+void
+Guards::setCondition(long nr, const std::string &expr)
+{
+    if (Guard *guard = guardNr(nr)) guard->condition = std::make_shared<Condition>(moira, expr);
+}
+
+void
+Guards::setConditionAt(u32 addr, const std::string &expr)
+{
+    if (Guard *guard = guardAt(addr)) guard->condition = std::make_shared<Condition>(moira, expr);
+}
+
+void
+Guards::removeCondition(long nr)
+{
+    if (Guard *guard = guardNr(nr)) guard->condition = nullptr;
+}
+
+void
+Guards::removeConditionAt(u32 addr)
+{
+    if (Guard *guard = guardAt(addr)) guard->condition = nullptr;
+}
+
 bool
 Guards::eval(u32 addr, Size S)
 {
-    for (int i = 0; i < count; i++) {
+    // Exit early if no guard is located in the accessed pages
+    if (!mayMatch(addr, S)) return false;
+    
+    long nr[4];
+    int n = collect(addr, S, nr);
+    
+    for (int i = 0; i < n; i++) {
         
-        if (guards[i].eval(addr, S)) {
+        if (guards[nr[i]].eval(addr, S)) {
             
-            hit = guards[i];
+            hit = guards[nr[i]];
             return true;
         }
     }
     return false;
 }
 
+bool
+Guards::matches(u32 addr, Size S) const
+{
+    if (!mayMatch(addr, S)) return false;
+    
+    long nr[4];
+    int n = collect(addr, S, nr);
+    
+    for (int i = 0; i < n; i++) {
+        
+        auto &guard = guards[nr[i]];
+        if (guard.enabled && (!guard.condition || guard.condition->eval(guard.hits + 1))) return true;
+    }
+    return false;
+}
+
+int
+Guards::collect(u32 addr, Size S, long *result) const
+{
+    int n = 0;
+    
+    for (u32 i = 0; i < u32(S) && addr + i >= addr; i++) {
+        
+        if (auto it = lookup.find(addr + i); it != lookup.end()) {
+            
+            // Keep the array order to preserve the evaluation order of ignore counters
+            int j = n++;
+            for (; j > 0 && result[j - 1] > it->second; j--) result[j] = result[j - 1];
+            result[j] = it->second;
+        }
+    }
+    return n;
+}
+
+void
+Guards::index(long nr)
+{
+    u32 addr = guards[nr].addr;
+    u32 page = (addr >> pageBits) & (pageCount - 1);
+    
+    lookup[addr] = nr;
+    if (!pages) pages = std::make_unique<u64[]>(pageCount / 64);
+    if (pageRefs[page]++ == 0) pages[page >> 6] |= u64(1) << (page & 63);
+}
+
+void
+Guards::unindex(long nr)
+{
+    u32 addr = guards[nr].addr;
+    u32 page = (addr >> pageBits) & (pageCount - 1);
+    
+    lookup.erase(addr);
+    if (--pageRefs[page] == 0) {
+        
+        pageRefs.erase(page);
+        pages[page >> 6] &= ~(u64(1) << (page & 63));
+        
+        // Free the bitmap when the last guard is gone
+        if (pageRefs.empty()) pages.reset();
+    }
+}
+
 void
 Breakpoints::setNeedsCheck(bool value)
 {
@@ -184,9 +318,174 @@ Breakpoints::setNeedsCheck(bool value)
     }
 }
 
+std::optional<WatchRange>
+Watchpoints::rangeNr(long nr) const
+{
+    if (nr >= 0 && nr < rangeCount()) return ranges[nr];
+    return { };
+}
+
+void
+Watchpoints::setRange(u32 first, u32 last, bool read, bool write)
+{
+    if (first > last) std::swap(first, last);
+    
+    ranges.push_back(WatchRange { .first = first, .last = last, .read = read, .write = write });
+    rebuildRanges();
+    setNeedsCheck(true);
+}
+
+void
+Watchpoints::removeRange(long nr)
+{
+    if (nr >= 0 && nr < rangeCount()) {
+        
+        ranges.erase(ranges.begin() + nr);
+        rebuildRanges();
+    }
+    setNeedsCheck(elements() != 0);
+}
+
+void
+Watchpoints::removeAllRanges()
+{
+    ranges.clear();
+    rebuildRanges();
+    setNeedsCheck(elements() != 0);
+}
+
+void
+Watchpoints::setRangeEnable(long nr, bool val)
+{
+    if (nr >= 0 && nr < rangeCount()) ranges[nr].enabled = val;
+}
+
+void
+Watchpoints::ignoreRange(long nr, long count)
+{
+    if (nr >= 0 && nr < rangeCount()) ranges[nr].ignore = count;
+}
+
+void
+Watchpoints::setRangeCondition(long nr, const std::string &expr)
+{
+    if (nr >= 0 && nr < rangeCount()) ranges[nr].condition = std::make_shared<Condition>(moira, expr);
+}
+
+void
+Watchpoints::removeRangeCondition(long nr)
+{
+    if (nr >= 0 && nr < rangeCount()) ranges[nr].condition = nullptr;
+}
+
+bool
+Watchpoints::eval(u32 addr, Size S, bool isWrite)
+{
+    if (Guards::eval(addr, S)) { rangeHit = { }; return true; }
+    
+    long match = -1;
+    
+    visit(addr, S, [&](long nr) {
+        
+        if (!ranges[nr].eval(isWrite)) return false;
+        match = nr;
+        return true;
+    });
+    
+    if (match < 0) return false;
+    
+    // Describe the range as a guard observing its first address
+    auto &range = ranges[match];
+    hit = Guard {
+        
+        .addr = range.first,
+        .enabled = range.enabled,
+        .ignore = range.ignore,
+        .condition = range.condition,
+        .hits = range.hits
+    };
+    rangeHit = range;
+    return true;
+}
+
+bool
+Watchpoints::matches(u32 addr, Size S, bool isWrite) const
+{
+    if (Guards::matches(addr, S)) return true;
+    
+    return visit(addr, S, [&](long nr) {
+        
+        auto &range = ranges[nr];
+        if (!range.enabled || !(isWrite ? range.write : range.read)) return false;
+        return !range.condition || range.condition->eval(range.hits + 1);
+    });
+}
+
+template <typename F> bool
+Watchpoints::visit(u32 addr, Size S, F &&func) const
+{
+    u32 first = addr;
+    u32 last = addr + u32(S) - 1 >= addr ? addr + u32(S) - 1 : UINT32_MAX;
+    
+    // Exit early if no range covers the accessed pages
+    if (!rangePageBit(first) && !rangePageBit(last)) return false;
+    
+    // Find the first range starting behind the accessed area
+    auto it = std::upper_bound(sorted.begin(), sorted.end(), last, [&](u32 value, long nr) {
+        return value < ranges[nr].first;
+    });
+    
+    // Visit all preceding ranges that reach into the accessed area
+    for (long i = long(it - sorted.begin()) - 1; i >= 0 && maxLast[i] >= first; i--) {
+        
+        if (ranges[sorted[i]].last >= first && func(sorted[i])) return true;
+    }
+    return false;
+}
+
+void
+Watchpoints::rebuildRanges()
+{
+    sorted.resize(ranges.size());
+    maxLast.resize(ranges.size());
+    
+    // Allocate the bitmap only if ranges exist
+    if (ranges.empty()) {
+        rangePages.reset();
+    } else if (rangePages) {
+        std::memset(rangePages.get(), 0, pageCount / 8);
+    } else {
+        rangePages = std::make_unique<u64[]>(pageCount / 64);
+    }
+    
+    for (long i = 0; i < rangeCount(); i++) sorted[i] = i;
+    std::sort(sorted.begin(), sorted.end(), [&](long a, long b) {
+        return ranges[a].first < ranges[b].first;
+    });
+    
+    for (long i = 0; i < rangeCount(); i++) {
+        
+        auto &range = ranges[sorted[i]];
+        maxLast[i] = i ? std::max(maxLast[i - 1], range.last) : range.last;
+        
+        // Mark all covered pages (large ranges cover all pages)
+        u64 firstPage = range.first >> pageBits, lastPage = range.last >> pageBits;
+        if (lastPage - firstPage >= pageCount) { lastPage = firstPage + pageCount - 1; }
+        
+        for (u64 page = firstPage; page <= lastPage; page++) {
+            
+            u32 nr = u32(page) & (pageCount - 1);
+            rangePages[nr >> 6] |= u64(1) << (nr & 63);
+        }
+    }
+}
+
 void
 Watchpoints::setNeedsCheck(bool value)
 {
+    // Keep checking as long as range watchpoints exist
+    value |= !ranges.empty();
+    
     if (value) {
         moira.flags |= Moira::CPU_CHECK_WP;
     } else {
@@ -236,6 +535,12 @@ Debugger::reset()
 {
     breakpoints.setNeedsCheck(breakpoints.elements() != 0);
     watchpoints.setNeedsCheck(watchpoints.elements() != 0);
+    
+    // The recorded history ends with a reset
+    timeMachine.setEnabled(timeMachine.isEnabled());
+    
+    // Continue tracing (the next entry is written as a key frame)
+    tracer.setEnabled(tracer.isEnabled());
 }
 
 void
@@ -256,6 +561,8 @@ Debugger::stepOver()
 bool
 Debugger::softstopMatches(u32 addr)
 {
+    if (timeMachine.isReplaying()) return false;
+    
     if (softStop && (*softStop < 0 || *softStop == addr)) {
         
         // Soft breakpoints are deleted when reached
@@ -269,18 +576,34 @@ Debugger::softstopMatches(u32 addr)
 bool
 Debugger::breakpointMatches(u32 addr)
 {
+    if (timeMachine.isReplaying()) {
+        
+        // Debug events are recorded but not triggered during a replay
+        if (breakpoints.matches(addr)) timeMachine.recordHit();
+        return false;
+    }
     return breakpoints.eval(addr);
 }
 
 bool
-Debugger::watchpointMatches(u32 addr, Size S)
+Debugger::watchpointMatches(u32 addr, Size S, bool write)
 {
-    return watchpoints.eval(addr, S);
+    if (timeMachine.isReplaying()) {
+        
+        if (watchpoints.matches(addr, S, write)) timeMachine.recordHit();
+        return false;
+    }
+    return watchpoints.eval(addr, S, write);
 }
 
 bool
 Debugger::catchpointMatches(u32 vectorNr)
 {
+    if (timeMachine.isReplaying()) {
+        
+        if (catchpoints.matches(vectorNr)) timeMachine.recordHit();
+        return false;
+    }
     return catchpoints.eval(vectorNr);
 }
 
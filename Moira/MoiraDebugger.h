@@ -11,7 +11,13 @@
 
 #include "MoiraTypes.h"
 #include "StrWriter.h"
+#include "MoiraTimeMachine.h"
+#include "MoiraTracer.h"
+#include "MoiraCondition.h"
 #include <map>
+#include <memory>
+#include <vector>
+#include <unordered_map>
 
 namespace moira {
 
@@ -30,6 +36,12 @@ struct Guard {
     // Ignore counter
     long ignore = 0;
     
+    // Optional condition (evaluated before the ignore counter is consulted)
+    std::shared_ptr<Condition> condition;
+    
+    // Number of times the guard's address has been matched while enabled
+    i64 hits = 0;
+    
 public:
     
     // Returns true if the guard hits
@@ -38,6 +50,39 @@ public:
 };
 
 
+//
+// A watchpoint observing an address range
+//
+
+struct WatchRange {
+    
+    // The observed address range (both bounds are included)
+    u32 first = 0;
+    u32 last = 0;
+    
+    // Observed access types
+    bool read = true;
+    bool write = true;
+    
+    // Disabled ranges never trigger
+    bool enabled = true;
+    
+    // Ignore counter
+    long ignore = 0;
+    
+    // Optional condition (evaluated before the ignore counter is consulted)
+    std::shared_ptr<Condition> condition;
+    
+    // Number of times the range has been matched while enabled
+    i64 hits = 0;
+    
+public:
+    
+    // Returns true if the range hits for the given access type
+    bool eval(bool isWrite);
+};
+
+
 //
 // A collection of breakpoints, watchpoints, or catchpoints
 //
@@ -48,6 +93,9 @@ class Guards {
     
 protected:
     
+    // Reference to the connected CPU
+    class Moira &moira;
+    
     // Capacity of the guards array
     long capacity = 1;
     
@@ -57,6 +105,23 @@ protected:
     // Number of currently stored guards
     long count = 0;
     
+    // Maps the address of each guard to its position in the guards array
+    std::unordered_map<u32, long> lookup;
+    
+    /* Presence bitmap. A bit is set if a guard is located in the corresponding
+     * page. Addresses beyond the 24-bit range are folded into this range.
+     * Hence, a set bit only indicates that a guard might exist, whereas a
+     * cleared bit rules out a match without consulting the lookup table. The
+     * bitmap is allocated when the first guard is added. As long as it is
+     * missing, no page is watched.
+     */
+    static constexpr int pageBits = 8;
+    static constexpr u32 pageCount = 1 << (24 - pageBits);
+    std::unique_ptr<u64[]> pages;
+    
+    // Number of guards in each page with a set bit in the presence bitmap
+    std::unordered_map<u32, long> pageRefs;
+    
 public:
     
     // A copy of the latest match
@@ -69,7 +134,7 @@ public:
     
 public:
     
-    // Guards(Moira& ref) : moira(ref) { }
+    Guards(Moira& ref) : moira(ref) { }
     virtual ~Guards();
     
     
@@ -95,7 +160,7 @@ public:
     
     void remove(long nr);
     void removeAt(u32 addr);
-    void removeAll() { count = 0; setNeedsCheck(false); }
+    void removeAll();
     
     void replace(long nr, u32 addr);
     
@@ -119,6 +184,18 @@ public:
     void ignore(long nr, long count);
     
     
+    //
+    // Attaching conditions
+    //
+    
+    // Compiles and attaches a condition (throws a std::runtime_error on errors)
+    void setCondition(long nr, const std::string &expr);
+    void setConditionAt(u32 addr, const std::string &expr);
+    
+    void removeCondition(long nr);
+    void removeConditionAt(u32 addr);
+    
+    
     //
     // Checking guards
     //
@@ -128,35 +205,121 @@ public:
     
     // Evaluates all guards
     bool eval(u32 addr, Size S = Byte);
+    
+    // Checks if an enabled guard matches without updating any counters
+    bool matches(u32 addr, Size S = Byte) const;
+    
+private:
+    
+    // Checks the presence bitmap for a potential guard in [addr; addr + S)
+    bool mayMatch(u32 addr, Size S) const {
+        return pageBit(addr) || pageBit(addr + u32(S) - 1);
+    }
+    bool pageBit(u32 addr) const {
+        u32 nr = (addr >> pageBits) & (pageCount - 1);
+        return pages && ((pages[nr >> 6] >> (nr & 63)) & 1);
+    }
+    
+    // Collects the positions of all guards in [addr; addr + S) in array order
+    int collect(u32 addr, Size S, long *result) const;
+    
+    // Registers or unregisters the guard stored at the specified position
+    void index(long nr);
+    void unindex(long nr);
 };
 
 class Breakpoints : public Guards {
     
-    class Moira &moira;
-    
 public:
     
-    Breakpoints(Moira& ref) : moira(ref) { }
+    Breakpoints(Moira& ref) : Guards(ref) { }
     void setNeedsCheck(bool value) override;
 };
 
 class Watchpoints : public Guards {
     
-    class Moira &moira;
+    // Array holding all range watchpoints (in the order they have been set)
+    std::vector<WatchRange> ranges;
+    
+    // Positions of all ranges, sorted by the first address
+    std::vector<long> sorted;
+    
+    // Maximum last address of all ranges up to a certain position in 'sorted'
+    std::vector<u32> maxLast;
+    
+    // Presence bitmap for ranges (same layout as the guard bitmap)
+    std::unique_ptr<u64[]> rangePages;
     
 public:
     
-    Watchpoints(Moira& ref) : moira(ref) { }
+    // A copy of the latest range match (empty if a single address matched).
+    // If a range matches, 'hit' holds a guard describing the range.
+    std::optional <WatchRange> rangeHit;
+    
+    
+    //
+    // Constructing
+    //
+    
+public:
+    
+    Watchpoints(Moira& ref) : Guards(ref) { }
+    
+    
+    //
+    // Managing range watchpoints
+    //
+    
+    long rangeCount() const { return (long)ranges.size(); }
+    std::optional<WatchRange> rangeNr(long nr) const;
+    
+    // Observes all read and/or write accesses to [first; last]
+    void setRange(u32 first, u32 last, bool read = true, bool write = true);
+    
+    void removeRange(long nr);
+    void removeAllRanges();
+    
+    void setRangeEnable(long nr, bool val);
+    void ignoreRange(long nr, long count);
+    
+    // Compiles and attaches a condition (throws a std::runtime_error on errors)
+    void setRangeCondition(long nr, const std::string &expr);
+    void removeRangeCondition(long nr);
+    
+    
+    //
+    // Checking watchpoints
+    //
+    
     void setNeedsCheck(bool value) override;
+    
+    // Evaluates all guards and ranges
+    using Guards::eval;
+    bool eval(u32 addr, Size S, bool isWrite);
+    
+    // Checks if an enabled guard or range matches without updating any counters
+    using Guards::matches;
+    bool matches(u32 addr, Size S, bool isWrite) const;
+    
+private:
+    
+    bool rangePageBit(u32 addr) const {
+        u32 nr = (addr >> pageBits) & (pageCount - 1);
+        return rangePages && ((rangePages[nr >> 6] >> (nr & 63)) & 1);
+    }
+    
+    // Visits all ranges overlapping [addr; addr + S) until the visitor returns true
+    template <typename F> bool visit(u32 addr, Size S, F &&func) const;
+    
+    // Rebuilds the interval index and the presence bitmap
+    void rebuildRanges();
 };
 
 class Catchpoints : public Guards {
     
-    class Moira &moira;
-    
 public:
     
-    Catchpoints(Moira& ref) : moira(ref) { }
+    Catchpoints(Moira& ref) : Guards(ref) { }
     void setNeedsCheck(bool value) override;
 };
 
@@ -198,6 +361,12 @@ public:
     // Software traps
     SoftwareTraps swTraps;
     
+    // Execution history
+    TimeMachine timeMachine = TimeMachine(moira);
+    
+    // Instruction trace
+    Tracer tracer = Tracer(moira);
+    
 private:
     
     /* Soft breakpoint for implementing single-stepping. In contrast to a
@@ -256,7 +425,7 @@ public:
     // Checks whether a debug events should be triggered
     bool softstopMatches(u32 addr);
     bool breakpointMatches(u32 addr);
-    bool watchpointMatches(u32 addr, Size S);
+    bool watchpointMatches(u32 addr, Size S, bool write);
     bool catchpointMatches(u32 vectorNr);
     
     
@@ -292,6 +461,20 @@ public:
     
     // Continues program execution at the specified address
     void jump(u32 addr);
+    
+    
+    //
+    // Traveling in time (requires the time machine to be enabled)
+    //
+    
+    // Reverts the execution of the most recent instruction
+    bool stepBack() { return timeMachine.stepBack(); }
+    
+    // Travels back to the previous breakpoint, watchpoint, or catchpoint hit
+    bool reverseContinue() { return timeMachine.reverseContinue(); }
+    
+    // Travels to the first instruction starting at or after a certain cycle
+    bool seekToCycle(i64 cycle) { return timeMachine.seekToCycle(cycle); }
 };
 
 }
@@ -139,7 +139,7 @@ Moira::execAddressError(StackFrame frame, int delay)
     willExecute(EXC_ADDRESS_ERROR, 3);
     
     // Emulate additional delay
-    sync(delay);
+    BUS(sync)(delay);
     
     // Enter supervisor mode
     setSupervisorMode(true);
@@ -46,6 +46,7 @@ Moira::execLineA(u16 opcode)
         prefetch<C>();
 
         // Inform the delegate
+        flags |= CPU_DEBUG_EVENT;
         softwareTrapReached(reg.pc0);
         return;
     }
@@ -790,6 +791,9 @@ Moira::execBra(u16 opcode)
     //           .b  .b  .b        .w  .w  .w        .l  .l  .l
     CYCLES_IP   (10, 10, 10,       10, 10, 10,       10, 10, 10)
 
+    // Check for an idle loop
+    if (idleDetection && newpc < oldpc) detectIdleLoop();
+
     FINALIZE
 }
 
@@ -828,6 +832,9 @@ Moira::execBcc(u16 opcode)
         //           .b  .b  .b        .w  .w  .w        .l  .l  .l
         CYCLES_IP   (10, 10,  6,       10, 10,  6,        0,  0,  6)
 
+        // Check for an idle loop
+        if (idleDetection && newpc < oldpc) detectIdleLoop();
+
     } else {
 
         // Fall through to next instruction
@@ -1292,6 +1299,8 @@ Moira::execBsr(u16 opcode)
     //           .b  .b  .b        .w  .w  .w        .l  .l  .l
     CYCLES_IP   (18, 18,  7,       18, 18,  7,       18, 18,  7)
 
+    if (callGraph.isEnabled() && isAnalyzing()) callGraph.call(reg.pc);
+
     FINALIZE
 }
 
@@ -1877,6 +1886,9 @@ Moira::execDbcc(u16 opcode)
                 CYCLES_68000(10);
                 CYCLES_68020(6);
 
+                // Check for an accelerable loop
+                if (loopAcceleration && I == DBF) accelerateLoop(dn);
+
             } else {
 
                 (void)readMS<C, MEM_PROG, Word>(reg.pc + 2);
@@ -1926,7 +1938,7 @@ Moira::execDbcc(u16 opcode)
                 reg.pc = newpc;
                 fullPrefetch<C, POLLIPL>();
 
-                if (loop[queue.ird] && disp == -4) {
+                if (loop[queue.ird] != NO_HANDLER && disp == -4) {
 
                     // Enter loop mode
                     flags |= CPU_IS_LOOPING;
@@ -1936,6 +1948,9 @@ Moira::execDbcc(u16 opcode)
 
                 if (MIMIC_MUSASHI) SYNC(2);
                 CYCLES_68010(12);
+
+                // Check for an accelerable loop
+                if (loopAcceleration && I == DBF) accelerateLoop(dn);
                 return;
 
             } else {
@@ -2204,6 +2219,8 @@ Moira::execJsr(u16 opcode)
     CYCLES_DIPC ( 0,  0,  0,        0,  0,  0,       18, 18,  5)
     CYCLES_IXPC ( 0,  0,  0,        0,  0,  0,       22, 22,  7)
 
+    if (callGraph.isEnabled() && isAnalyzing()) callGraph.call(reg.pc);
+
     FINALIZE
 }
 
@@ -4033,6 +4050,9 @@ Moira::execRtd(u16 opcode)
 {
     AVAILABILITY(C68010)
 
+    // Remember the stack pointer for the call graph
+    u32 sp = reg.sp;
+
     bool error;
     u32 newpc = readM<C, M, Long>(reg.sp, error);
     if (error) return;
@@ -4051,6 +4071,8 @@ Moira::execRtd(u16 opcode)
     //           .b  .b  .b        .w  .w  .w        .l  .l  .l
     CYCLES_IP   ( 0,  0,  0,        0,  0,  0,        0, 16, 10)
 
+    if (callGraph.isEnabled() && isAnalyzing()) callGraph.ret(sp, callGraph.activeStack());
+
     FINALIZE
 }
 
@@ -4060,6 +4082,10 @@ Moira::execRte(u16 opcode)
     AVAILABILITY(C68000)
     SUPERVISOR_MODE_ONLY
 
+    // Remember the stack pointer for the call graph (ISP or MSP)
+    u32 sp = reg.sp;
+    u8 stack = reg.sr.m ? 2 : 1;
+
     u16 newsr = 0;
     u32 newpc = 0;
 
@@ -4214,6 +4240,8 @@ Moira::execRte(u16 opcode)
     //           .b  .b  .b        .w  .w  .w        .l  .l  .l
     CYCLES_IP   ( 0,  0,  0,        0,  0,  0,       20, 24, 20)
 
+    if (callGraph.isEnabled() && isAnalyzing()) callGraph.ret(sp, stack);
+
     FINALIZE
 }
 
@@ -4258,6 +4286,8 @@ Moira::execRtr(u16 opcode)
     //           .b  .b  .b        .w  .w  .w        .l  .l  .l
     CYCLES_IP   ( 0,  0,  0,        0,  0,  0,       20, 20, 14)
 
+    if (callGraph.isEnabled() && isAnalyzing()) callGraph.ret(reg.sp - 4, callGraph.activeStack());
+
     FINALIZE
 }
 
@@ -4284,6 +4314,8 @@ Moira::execRts(u16 opcode)
     //           .b  .b  .b        .w  .w  .w        .l  .l  .l
     CYCLES_IP   ( 0,  0,  0,        0,  0,  0,       16, 16, 10)
 
+    if (callGraph.isEnabled() && isAnalyzing()) callGraph.ret(reg.sp - 4, callGraph.activeStack());
+
     FINALIZE
 }
 
@@ -11,17 +11,29 @@
 #define EXEC_HANDLER(func,C,I,M,S) &Moira::exec##func<C,I,M,S>
 #define DASM_HANDLER(func,I,M,S) &Moira::dasm##func<I,M,S>
 
+// Assigns a handler id. Each expansion of a registration macro always
+// registers the same handler, so it gets an id of its own. The first two ids
+// are reserved (NO_HANDLER and HOOK_HANDLER).
+#define HANDLER_ID u16(__COUNTER__ - firstHandler + 1)
+
 // Registers an instruction handler
 #define CIMS(id,name,I,M,S) { \
-exec[id] = EXEC_HANDLER(name,C,I,M,S); \
-if (dasm) dasm[id] = DASM_HANDLER(name,I,M,S); \
+u16 handler = HANDLER_ID; \
+handlers[handler] = EXEC_HANDLER(name,C,I,M,S); \
+if (dasm) dasm[handler] = DASM_HANDLER(name,I,M,S); \
+if (names) names[handler] = "exec" #name; \
 if (info) info[id] = InstrInfo {I,M,S}; \
+exec[id] = handler; \
 }
 
 // Registers a special loop-mode instruction handler
 #define CIMSloop(id,name,I,M,S) { \
-assert(loop[id] == nullptr); \
-loop[id] = EXEC_HANDLER(name,C68010,I##_LOOP,M,S); \
+if (loop) { \
+assert(loop[id] == NO_HANDLER); \
+u16 handler = HANDLER_ID; \
+handlers[handler] = EXEC_HANDLER(name,C68010,I##_LOOP,M,S); \
+if (names) names[handler] = "exec" #name; \
+loop[id] = handler; } \
 }
 
 // Registers an instruction in one of the standard instruction formats:
@@ -131,6 +143,9 @@ if ((s) & 0b010) ____XXX___MMMXXX((op) | 3 << 12, I, m, Word, f, func); \
 if ((s) & 0b001) ____XXX___MMMXXX((op) | 1 << 12, I, m, Byte, f, func); }
 
 
+// Counter value preceding the first handler id
+static constexpr int firstHandler = __COUNTER__;
+
 static constexpr u16
 parse(const char *s, int sum = 0)
 {
@@ -144,22 +159,26 @@ parse(const char *s, int sum = 0)
 void
 Moira::createJumpTable()
 {
-    switch (model) {
-
-        case M68000:    createJumpTable<C68000>(); break;
-        case M68010:    createJumpTable<C68010>(); break;
-        case M68EC020:
-        case M68020:
-        case M68EC030:
-        case M68030:    createJumpTable<C68020>(); break;
-
-        default:
-            fatalError;
-    }
+    auto table = getJumpTable(model);
+    
+    execHandlers = table.execHandlers;
+    dasmHandlers = table.dasmHandlers;
+    names = table.names;
+    exec = plainExec = table.exec;
+    loop = plainLoop = table.loop;
+    info = table.info;
+    
+    // Reinstall hooks (if any)
+    if (hookedExec) updateHooks();
+    
+    // Discard all blocks referring to the old handlers
+    blockCache.flush();
 }
 
-template <Core C> void
-Moira::createJumpTable()
+template <Core C> constexpr void
+Moira::createJumpTable(Model model,
+                       ExecPtr *handlers, DasmPtr *dasm, const char **names,
+                       u16 *exec, u16 *loop, InstrInfo *info)
 {
     u16 opcode;
     
@@ -167,10 +186,12 @@ Moira::createJumpTable()
     // Start with clean tables
     //
     
+    handlers[HOOK_HANDLER] = &Moira::execHooked;
+    
     XXXXXXXXXXXXXXXX(ILLEGAL, MODE_IP, (Size)0, Illegal, CIMS)
     
-    for (int i = 0; i < 0x10000; i++) {
-        loop[i] = nullptr;
+    if (loop) {
+        for (int i = 0; i < 0x10000; i++) loop[i] = NO_HANDLER;
     }
     
     
@@ -1895,3 +1916,121 @@ Moira::createJumpTable()
     }
 }
 
+// Number of handler ids (including the reserved ones)
+static constexpr int handlerCount = __COUNTER__ - firstHandler + 1;
+static_assert(handlerCount <= 65536);
+
+void
+Moira::updateHooks()
+{
+    bool hooked = false;
+    
+    for (auto mask : instrHooks) hooked |= mask != 0;
+    for (int i = 0; opcodeHooks && i < 65536; i++) hooked |= opcodeHooks[i] != 0;
+    
+    if (!hooked) {
+        
+        // Switch back to the shared jump tables
+        delete [] hookedExec;
+        delete [] hookedLoop;
+        hookedExec = hookedLoop = nullptr;
+        exec = plainExec;
+        loop = plainLoop;
+        blockCache.flush();
+        return;
+    }
+    
+    if (!hookedExec) hookedExec = new u16[65536];
+    if (!hookedLoop && plainLoop) hookedLoop = new u16[65536];
+    if (hookedLoop && !plainLoop) { delete [] hookedLoop; hookedLoop = nullptr; }
+    
+    for (int i = 0; i < 65536; i++) {
+        
+        bool hook = instrHooks[info[i].I] || (opcodeHooks && opcodeHooks[i]);
+        hookedExec[i] = hook ? HOOK_HANDLER : plainExec[i];
+        
+        // Opcodes without a loop mode handler must stay unregistered
+        if (hookedLoop) {
+            hookedLoop[i] = hook && plainLoop[i] != NO_HANDLER ? HOOK_HANDLER : plainLoop[i];
+        }
+    }
+    exec = hookedExec;
+    loop = hookedLoop ? hookedLoop : plainLoop;
+    blockCache.flush();
+}
+
+Moira::JumpTable
+Moira::getJumpTable(Model model)
+{
+    struct Tables {
+        
+        ExecPtr handlers[handlerCount] = { };
+        DasmPtr dasm[ENABLE_DASM ? handlerCount : 1] = { };
+        const char *names[BUILD_INSTR_INFO_TABLE ? handlerCount : 1] = { };
+        u16 exec[65536] = { };
+        InstrInfo info[BUILD_INSTR_INFO_TABLE ? 65536 : 1] = { };
+    };
+    
+    struct LoopTables : Tables {
+        
+        u16 loop[65536] = { };
+    };
+    
+    #define DASM_TABLE(t) (ENABLE_DASM ? (t).dasm : nullptr)
+    #define INFO_TABLE(t) (BUILD_INSTR_INFO_TABLE ? (t).info : nullptr)
+    #define NAME_TABLE(t) (BUILD_INSTR_INFO_TABLE ? (t).names : nullptr)
+    #define TABLES(t) (t).handlers, DASM_TABLE(t), NAME_TABLE(t), (t).exec
+    
+    // The 68020 and 68EC020 share the same tables (same for the 68030 models)
+    static constexpr Tables t68000 = [] {
+        Tables t;
+        createJumpTable<C68000>(M68000, TABLES(t), nullptr, INFO_TABLE(t));
+        return t;
+    }();
+    static constexpr LoopTables t68010 = [] {
+        LoopTables t;
+        createJumpTable<C68010>(M68010, TABLES(t), t.loop, INFO_TABLE(t));
+        return t;
+    }();
+    static constexpr Tables t68020 = [] {
+        Tables t;
+        createJumpTable<C68020>(M68020, TABLES(t), nullptr, INFO_TABLE(t));
+        return t;
+    }();
+    static constexpr Tables t68030 = [] {
+        Tables t;
+        createJumpTable<C68020>(M68030, TABLES(t), nullptr, INFO_TABLE(t));
+        return t;
+    }();
+    
+    auto connect = [](const Tables &t, const u16 *loop) {
+        
+        return JumpTable {
+            
+            .execHandlers = t.handlers,
+            .dasmHandlers = DASM_TABLE(t),
+            .names = NAME_TABLE(t),
+            .exec = t.exec,
+            .loop = loop,
+            .info = INFO_TABLE(t)
+        };
+    };
+    
+    #undef DASM_TABLE
+    #undef INFO_TABLE
+    #undef NAME_TABLE
+    #undef TABLES
+    
+    switch (model) {
+            
+        case M68000:    return connect(t68000, nullptr);
+        case M68010:    return connect(t68010, t68010.loop);
+        case M68EC020:
+        case M68020:    return connect(t68020, nullptr);
+        case M68EC030:
+        case M68030:    return connect(t68030, nullptr);
+            
+        default:
+            fatalError;
+    }
+}
@@ -16,15 +16,21 @@
 #endif
 #define fatalError      assert(false); unreachable
 
+#ifdef MOIRA_BUS
+#define BUS(func)       static_cast<MOIRA_BUS *>(this)->MOIRA_BUS::func
+#else
+#define BUS(func)       func
+#endif
+
 #if PRECISE_TIMING == true
 
-#define SYNC(x)         { if constexpr (C != C68020) sync(x); }
-#define SYNC_68000(x)   { if constexpr (C == C68000) sync(x); }
-#define SYNC_68010(x)   { if constexpr (C == C68010) sync(x); }
+#define SYNC(x)         { if constexpr (C != C68020) { if (preciseTiming) BUS(sync)(x); } }
+#define SYNC_68000(x)   { if constexpr (C == C68000) { if (preciseTiming) BUS(sync)(x); } }
+#define SYNC_68010(x)   { if constexpr (C == C68010) { if (preciseTiming) BUS(sync)(x); } }
 
-#define CYCLES_68000(c) { }
-#define CYCLES_68010(c) { }
-#define CYCLES_68020(c) { if constexpr (C == C68020) sync((c) + cp); }
+#define CYCLES_68000(c) { if constexpr (C == C68000) { if (!preciseTiming) BUS(sync)(c); } }
+#define CYCLES_68010(c) { if constexpr (C == C68010) { if (!preciseTiming) BUS(sync)(c); } }
+#define CYCLES_68020(c) { if constexpr (C == C68020) BUS(sync)((c) + cp); }
 
 #else
 
@@ -32,12 +38,15 @@
 #define SYNC_68000(x)   { }
 #define SYNC_68010(x)   { }
 
-#define CYCLES_68000(c) { if constexpr (C == C68000) sync(c); }
-#define CYCLES_68010(c) { if constexpr (C == C68010) sync(c); }
-#define CYCLES_68020(c) { if constexpr (C == C68020) sync((c) + cp); }
+#define CYCLES_68000(c) { if constexpr (C == C68000) BUS(sync)(c); }
+#define CYCLES_68010(c) { if constexpr (C == C68010) BUS(sync)(c); }
+#define CYCLES_68020(c) { if constexpr (C == C68020) BUS(sync)((c) + cp); }
 
 #endif
 
+// Checks if long word accesses have to be broken down into two word accesses
+#define SPLIT_LONG      ((PRECISE_TIMING && preciseTiming) || (EMULATE_ADDRESS_ERROR && addressErrors))
+
 #define CYCLES(c) { CYCLES_68000(c) CYCLES_68010(c) CYCLES_68020(c) }
 
 #define CYCLES_BWL_00(b,w,l) CYCLES_68000(S == Byte ? (b) : S == Word ? (w) : (l))
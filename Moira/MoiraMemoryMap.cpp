@@ -0,0 +1,76 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "MoiraMemoryMap.h"
+
+namespace moira {
+
+MemoryMap::~MemoryMap()
+{
+    if (pages) delete [] pages;
+}
+
+void
+MemoryMap::allocate()
+{
+    if (pages) return;
+
+    pages = new Page[pageCount];
+    for (u32 i = 0; i < pageCount; i++) pages[i] = { nullptr, nullptr };
+}
+
+void
+MemoryMap::map(u32 first, u32 last, const u8 *read, u8 *write)
+{
+    assert(first <= last && last <= 0xFFFFFF);
+    assert((first & (pageSize - 1)) == 0);
+    assert((last & (pageSize - 1)) == pageSize - 1);
+
+    // Keep all pages unmapped if the memory map is not compiled in
+    if constexpr (!ENABLE_MEMORY_MAP) return;
+
+    allocate();
+    generation++;
+
+    for (u32 i = first >> pageBits, offset = 0; i <= last >> pageBits; i++) {
+
+        pages[i].read = read ? read + offset : nullptr;
+        pages[i].write = write ? write + offset : nullptr;
+        offset += pageSize;
+    }
+}
+
+void
+MemoryMap::mapRam(u32 first, u32 last, u8 *host)
+{
+    map(first, last, host, host);
+}
+
+void
+MemoryMap::mapRom(u32 first, u32 last, const u8 *host)
+{
+    map(first, last, host, nullptr);
+}
+
+void
+MemoryMap::unmap(u32 first, u32 last)
+{
+    map(first, last, nullptr, nullptr);
+}
+
+void
+MemoryMap::clear()
+{
+    if (pages) delete [] pages;
+    pages = nullptr;
+    generation++;
+}
+
+}
@@ -0,0 +1,117 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+
+namespace moira {
+
+/* Memory map
+ *
+ * The memory map connects regions of the 24-bit address space to host memory.
+ * If a page is mapped, Moira accesses the host memory directly instead of
+ * calling read8(), read16(), write8(), or write16(). Data is stored in
+ * big-endian byte order, i.e., the host memory is expected to contain an
+ * exact image of the emulated memory. Unmapped pages (e.g., pages containing
+ * memory-mapped I/O registers) are handled by the virtual read and write
+ * functions as before. ROM pages are mapped for read accesses only. Writes
+ * into these pages are passed to write8() and write16(). The memory map
+ * requires ENABLE_MEMORY_MAP to be enabled.
+ */
+class MemoryMap {
+
+public:
+
+    // Page layout
+    static constexpr int pageBits = 12;
+    static constexpr u32 pageSize = 1 << pageBits;
+    static constexpr u32 pageCount = 1 << (24 - pageBits);
+
+private:
+
+    struct Page {
+
+        // Host memory used for read accesses (nullptr if unmapped)
+        const u8 *read;
+
+        // Host memory used for write accesses (nullptr if unmapped)
+        u8 *write;
+    };
+
+    // Page table (nullptr if no page is mapped)
+    Page *pages = nullptr;
+
+    // Incremented whenever the mapping changes
+    u64 generation = 0;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    ~MemoryMap();
+
+
+    //
+    // Configuring
+    //
+
+    // Maps a memory region to host memory (first and last must be page aligned)
+    void mapRam(u32 first, u32 last, u8 *host);
+    void mapRom(u32 first, u32 last, const u8 *host);
+
+    // Routes all accesses to the specified region to the virtual functions
+    void unmap(u32 first, u32 last);
+
+    // Unmaps all regions
+    void clear();
+
+    // Returns a counter which changes whenever the mapping changes
+    u64 getGeneration() const { return generation; }
+
+
+    //
+    // Accessing memory
+    //
+
+    // Returns the host memory location of a read access (if mapped)
+    template <Size S> const u8 *readPtr(u32 addr) const {
+
+        if (!pages) return nullptr;
+
+        const u8 *p = pages[addr >> pageBits].read;
+        if (!p || (addr & (pageSize - 1)) > pageSize - S) return nullptr;
+
+        return p + (addr & (pageSize - 1));
+    }
+
+    // Returns the host memory location of a write access (if mapped)
+    template <Size S> u8 *writePtr(u32 addr) const {
+
+        if (!pages) return nullptr;
+
+        u8 *p = pages[addr >> pageBits].write;
+        if (!p || (addr & (pageSize - 1)) > pageSize - S) return nullptr;
+
+        return p + (addr & (pageSize - 1));
+    }
+
+private:
+
+    // Allocates the page table
+    void allocate();
+
+    // Maps a memory region
+    void map(u32 first, u32 last, const u8 *read, u8 *write);
+};
+
+}
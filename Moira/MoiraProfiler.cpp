@@ -0,0 +1,169 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "Moira.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace moira {
+
+Profiler::~Profiler()
+{
+    if (pages) {
+
+        for (u32 i = 0; i < pageCount; i++) delete [] pages[i];
+        delete [] pages;
+    }
+    delete [] opcodes;
+}
+
+void
+Profiler::setEnabled(bool value)
+{
+    enabled = value;
+
+    if (value) {
+
+        // Allocate the counter tables on first use
+        if (!pages) pages = new Counter *[pageCount]();
+        if (!opcodes) opcodes = new Counter[65536]();
+
+        moira.flags |= Moira::CPU_PROFILE;
+
+    } else {
+
+        moira.flags &= ~Moira::CPU_PROFILE;
+    }
+}
+
+void
+Profiler::clear()
+{
+    if (pages) {
+
+        for (u32 i = 0; i < pageCount; i++) { delete [] pages[i]; pages[i] = nullptr; }
+    }
+    if (opcodes) {
+
+        std::fill(opcodes, opcodes + 65536, Counter { });
+    }
+}
+
+std::vector<Hotspot>
+Profiler::pcHotspots(size_t count) const
+{
+    std::vector<Hotspot> result;
+
+    if (pages) {
+
+        for (u32 i = 0; i < pageCount; i++) {
+
+            if (!pages[i]) continue;
+
+            for (u32 j = 0; j < pageSize; j++) {
+
+                auto &counter = pages[i][j];
+                if (counter.hits) result.push_back({ (i << pageBits | j) << 1, counter.hits, counter.cycles });
+            }
+        }
+    }
+
+    sort(result, count);
+    return result;
+}
+
+std::vector<Hotspot>
+Profiler::opcodeHotspots(size_t count) const
+{
+    std::vector<Hotspot> result;
+
+    if (opcodes) {
+
+        for (u32 i = 0; i < 65536; i++) {
+
+            auto &counter = opcodes[i];
+            if (counter.hits) result.push_back({ i, counter.hits, counter.cycles });
+        }
+    }
+
+    sort(result, count);
+    return result;
+}
+
+std::vector<Hotspot>
+Profiler::instrHotspots(size_t count) const
+{
+    std::vector<Hotspot> result;
+
+    if constexpr (BUILD_INSTR_INFO_TABLE) {
+
+        std::vector<Hotspot> table(TST_LOOP + 1);
+        for (u32 i = 0; i < table.size(); i++) table[i].key = i;
+
+        for (auto &entry : opcodeHotspots()) {
+
+            auto &item = table[moira.getInfo(u16(entry.key)).I];
+            item.hits += entry.hits;
+            item.cycles += entry.cycles;
+        }
+        for (auto &item : table) {
+            if (item.hits) result.push_back(item);
+        }
+    }
+
+    sort(result, count);
+    return result;
+}
+
+void
+Profiler::dump(std::ostream &os, size_t count) const
+{
+    char line[256], dasm[128];
+
+    i64 total = 0;
+    for (auto &entry : opcodeHotspots()) total += entry.cycles;
+
+    auto percent = [&](i64 cycles) { return total ? 100.0 * double(cycles) / double(total) : 0.0; };
+
+    os << "Program counter hotspots:\n";
+
+    for (auto &entry : pcHotspots(count)) {
+
+        if constexpr (ENABLE_DASM) {
+            moira.disassemble(entry.key, dasm);
+        } else {
+            dasm[0] = 0;
+        }
+        snprintf(line, sizeof(line), "%06X %12lld %14lld %6.2f%%  %s\n",
+                 entry.key, entry.hits, entry.cycles, percent(entry.cycles), dasm);
+        os << line;
+    }
+
+    os << "Opcode hotspots:\n";
+
+    for (auto &entry : opcodeHotspots(count)) {
+
+        snprintf(line, sizeof(line), "  %04X %12lld %14lld %6.2f%%\n",
+                 entry.key, entry.hits, entry.cycles, percent(entry.cycles));
+        os << line;
+    }
+}
+
+void
+Profiler::sort(std::vector<Hotspot> &table, size_t count)
+{
+    std::sort(table.begin(), table.end(), [](const Hotspot &a, const Hotspot &b) {
+        return a.cycles != b.cycles ? a.cycles > b.cycles : a.key < b.key;
+    });
+
+    if (table.size() > count) table.resize(count);
+}
+
+}
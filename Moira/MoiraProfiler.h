@@ -0,0 +1,123 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+#include <ostream>
+#include <vector>
+
+namespace moira {
+
+struct Hotspot {
+
+    u32 key;                // Program counter, opcode, or instruction (Instr)
+    i64 hits;               // Number of executions
+    i64 cycles;             // Number of consumed cycles
+};
+
+/* Execution profiler
+ *
+ * If enabled, the profiler counts the executions and consumed cycles of each
+ * instruction, keyed by the program counter and by the opcode. Enabling the
+ * profiler sets a CPU flag which routes all instructions through the slow
+ * execution path. Hence, the profiler causes no overhead if disabled. The
+ * counters for the program counter are stored in pages which are allocated
+ * on demand.
+ */
+class Profiler {
+
+    // Reference to the connected CPU
+    class Moira &moira;
+
+    struct Counter {
+
+        i64 hits;
+        i64 cycles;
+    };
+
+    // Page layout (a page covers 4 KB of the address space)
+    static constexpr int pageBits = 11;
+    static constexpr u32 pageSize = 1 << pageBits;
+    static constexpr u32 pageCount = 1 << (23 - pageBits);
+
+    // Counters indexed by the program counter (nullptr if not allocated)
+    Counter **pages = nullptr;
+
+    // Counters indexed by the opcode (nullptr if not allocated)
+    Counter *opcodes = nullptr;
+
+    // Indicates if profiling is enabled
+    bool enabled = false;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    Profiler(Moira& ref) : moira(ref) { }
+    ~Profiler();
+
+
+    //
+    // Configuring
+    //
+
+    // Starts or stops recording (the recorded data is kept)
+    bool isEnabled() const { return enabled; }
+    void setEnabled(bool value);
+
+    // Deletes all recorded data
+    void clear();
+
+
+    //
+    // Recording (called by the CPU)
+    //
+
+    void record(u32 pc, u16 opcode, i64 cycles) {
+
+        u32 nr = (pc & 0xFFFFFF) >> 1;
+        Counter *&page = pages[nr >> pageBits];
+        if (!page) page = new Counter[pageSize]();
+
+        page[nr & (pageSize - 1)].hits++;
+        page[nr & (pageSize - 1)].cycles += cycles;
+        opcodes[opcode].hits++;
+        opcodes[opcode].cycles += cycles;
+    }
+
+
+    //
+    // Analyzing the recorded data
+    //
+
+    /* Returns hotspot tables sorted by the number of consumed cycles
+     *
+     * pcHotspots() and opcodeHotspots() return one entry per executed program
+     * counter or opcode, respectively. instrHotspots() combines all opcodes of
+     * the same instruction and requires BUILD_INSTR_INFO_TABLE to be enabled.
+     * At most 'count' entries are returned.
+     */
+    std::vector<Hotspot> pcHotspots(size_t count = SIZE_MAX) const;
+    std::vector<Hotspot> opcodeHotspots(size_t count = SIZE_MAX) const;
+    std::vector<Hotspot> instrHotspots(size_t count = SIZE_MAX) const;
+
+    // Prints the hottest program counters and opcodes
+    void dump(std::ostream &os, size_t count = 20) const;
+
+private:
+
+    // Sorts a hotspot table and truncates it to the specified size
+    static void sort(std::vector<Hotspot> &table, size_t count);
+};
+
+}
@@ -0,0 +1,131 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "Moira.h"
+#include <bit>
+
+namespace moira {
+
+Sampler::~Sampler()
+{
+    delete [] buffer;
+}
+
+void
+Sampler::setEnabled(bool value)
+{
+    enabled = value;
+
+    if (value) {
+
+        if (!buffer) setCapacity(4096);
+        if (event < 0) event = moira.scheduler.add([this]() { serve(); }, true);
+        schedule(moira.clock + interval);
+
+    } else {
+
+        if (event >= 0) moira.scheduler.cancel(event);
+        moira.flags &= ~Moira::CPU_SAMPLE;
+    }
+}
+
+void
+Sampler::setInterval(i64 cycles)
+{
+    interval = cycles > 0 ? cycles : 1;
+
+    if (enabled) schedule(moira.clock + interval);
+}
+
+void
+Sampler::setCapacity(size_t capacity)
+{
+    capacity = std::bit_ceil(capacity > 1 ? capacity : 1);
+
+    delete [] buffer;
+    buffer = new Sample[capacity];
+    mask = capacity - 1;
+
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+}
+
+size_t
+Sampler::drain(std::span<Sample> samples)
+{
+    u64 t = tail.load(std::memory_order_relaxed);
+    u64 h = head.load(std::memory_order_acquire);
+
+    size_t count = 0;
+    for (; t != h && count < samples.size(); t++, count++) samples[count] = buffer[t & mask];
+
+    tail.store(t, std::memory_order_release);
+    return count;
+}
+
+void
+Sampler::schedule(i64 cycle)
+{
+    next = cycle;
+
+    if (next - lead > moira.clock) {
+
+        // Let the CPU run in the fast path until shortly before the sample
+        moira.flags &= ~Moira::CPU_SAMPLE;
+        moira.scheduler.schedule(event, next - lead);
+
+    } else {
+
+        moira.flags |= Moira::CPU_SAMPLE;
+        moira.scheduler.schedule(event, next);
+    }
+}
+
+void
+Sampler::serve()
+{
+    if (!(moira.flags & Moira::CPU_SAMPLE)) {
+
+        // Record the instructions executed until the sampling point is reached
+        moira.flags |= Moira::CPU_SAMPLE;
+        moira.scheduler.schedule(event, next);
+        return;
+    }
+
+    // Don't record the same sampling point twice when traveling in time
+    if (!moira.debugger.timeMachine.isReplaying()) record();
+
+    // Keep the sampling points in a fixed grid to avoid locking onto loops
+    schedule(next + interval > moira.clock ? next + interval : moira.clock + interval);
+}
+
+void
+Sampler::record()
+{
+    u64 h = head.load(std::memory_order_relaxed);
+
+    if (h - tail.load(std::memory_order_acquire) > mask) {
+
+        dropped.fetch_add(1, std::memory_order_relaxed);
+
+    } else {
+
+        buffer[h & mask] = Sample {
+
+            .clock = moira.clock,
+            .pc = moira.instrPC,
+            .opcode = moira.instrIRD,
+            .supervisor = moira.reg.sr.s
+        };
+        head.store(h + 1, std::memory_order_release);
+    }
+}
+
+}
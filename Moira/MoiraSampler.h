@@ -0,0 +1,157 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+#include <atomic>
+#include <cstddef>
+#include <span>
+
+namespace moira {
+
+struct Sample {
+
+    i64 clock;              // Cycle in which the sample has been taken
+    u32 pc;                 // Beginning of the executed instruction
+    u16 opcode;             // The executed instruction
+    bool supervisor;        // Supervisor bit of the status register
+};
+
+/* Sampling profiler
+ *
+ * If enabled, the sampler records the program counter, the opcode, and the
+ * supervisor bit in regular intervals. The samples are taken by an internal
+ * event of the scheduler. Hence, the client's sync() implementation needs to
+ * call Moira::sync(). As the event is served inside sync(), a sample refers to
+ * the instruction that was being executed when the sampling point was
+ * reached. This also holds if precise timing is disabled and sync() is called
+ * at the end of the instruction, after the next instruction has been
+ * prefetched.
+ *
+ * The start address and the opcode of the executed instruction are only
+ * recorded in the slow execution path. Therefore, the sampler sets the
+ * CPU_SAMPLE flag shortly before each sampling point and clears it after the
+ * sample has been taken. The lead time equals the duration of the longest
+ * instruction (maxInstrCycles). Hence, the instruction which is executed when
+ * the flag is set ends before the sampling point is reached. Between two
+ * samples, instructions are executed in the fast path without any additional
+ * code.
+ *
+ * The sampling points are placed on a fixed grid. To avoid aliasing with
+ * periodic loops, the interval should not be a multiple of typical loop
+ * durations (e.g., a prime number). No samples are taken while the time
+ * machine replays instructions, because these have been sampled before.
+ *
+ * The samples are stored in a preallocated ring buffer. The CPU thread is the
+ * only producer. A single consumer thread can drain the buffer concurrently.
+ * If the buffer is full, new samples are dropped and counted.
+ */
+class Sampler {
+
+public:
+
+    /* Upper bound for the duration of a single instruction in cycles
+     *
+     * The longest instruction is a 68000 DIVS with a negative dividend, a
+     * positive divisor, and a small quotient. The division takes
+     * 2 * (7 + 55 + 1 + 15) cycles (see cyclesDiv()). Fetching an operand
+     * addressed by an absolute long address takes up to 16 more cycles.
+     */
+    static constexpr i64 maxInstrCycles = 2 * (7 + 55 + 1 + 15) + 16;
+
+private:
+
+    // Reference to the connected CPU
+    class Moira &moira;
+
+    // The ring buffer (the capacity is a power of two)
+    Sample *buffer = nullptr;
+    u64 mask = 0;
+
+    // Read and write positions (only increase)
+    alignas(64) std::atomic<u64> head = 0;
+    alignas(64) std::atomic<u64> tail = 0;
+
+    // Number of samples that have been dropped because the buffer was full
+    std::atomic<i64> dropped = 0;
+
+    // Number of cycles between two samples
+    i64 interval = 10000;
+
+    // Number of cycles between setting CPU_SAMPLE and taking a sample
+    static constexpr i64 lead = maxInstrCycles;
+
+    // The cycle of the next sampling point
+    i64 next = 0;
+
+    // Id of the scheduler event (-1 if not registered yet)
+    int event = -1;
+
+    // Indicates if sampling is enabled
+    bool enabled = false;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    Sampler(Moira& ref) : moira(ref) { }
+    ~Sampler();
+
+
+    //
+    // Configuring (call from the CPU thread only)
+    //
+
+    // Starts or stops sampling
+    bool isEnabled() const { return enabled; }
+    void setEnabled(bool value);
+
+    // Sets the number of cycles between two samples
+    i64 getInterval() const { return interval; }
+    void setInterval(i64 cycles);
+
+    /* Allocates a ring buffer for the specified number of samples
+     *
+     * The capacity is rounded up to the next power of two. All samples that
+     * have not been drained are discarded. Must not be called while a
+     * consumer is draining the buffer.
+     */
+    void setCapacity(size_t capacity);
+
+
+    //
+    // Consuming samples (call from a single consumer thread)
+    //
+
+    // Moves up to buffer.size() samples into the provided buffer
+    size_t drain(std::span<Sample> samples);
+
+    // Returns the number of samples waiting to be drained
+    size_t pending() const { return size_t(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)); }
+
+    // Returns the number of dropped samples
+    i64 getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+
+    // Schedules the next sampling point
+    void schedule(i64 cycle);
+
+    // Sets CPU_SAMPLE or records a sample (called by the scheduler)
+    void serve();
+
+    // Records a single sample
+    void record();
+};
+
+}
@@ -0,0 +1,169 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "MoiraScheduler.h"
+
+namespace moira {
+
+int
+Scheduler::add(Callback callback, bool internal)
+{
+    int id = 0;
+
+    // Reuse an unused entry if possible
+    while (id < (int)events.size() && events[id].used) id++;
+    if (id == (int)events.size()) events.push_back(Event { });
+
+    events[id].callback = std::make_shared<const Callback>(std::move(callback));
+    events[id].used = true;
+    events[id].internal = internal;
+    return id;
+}
+
+void
+Scheduler::remove(int id)
+{
+    cancel(id);
+    events[id] = Event { };
+}
+
+void
+Scheduler::schedule(int id, i64 cycle)
+{
+    assert(id >= 0 && id < (int)events.size() && events[id].used);
+
+    auto &event = events[id];
+
+    if (event.slot < 0) {
+
+        event.trigger = cycle;
+        heap.push_back(id);
+        event.slot = (int)heap.size() - 1;
+        siftUp(event.slot);
+
+    } else {
+
+        bool earlier = cycle < event.trigger;
+        event.trigger = cycle;
+        earlier ? siftUp(event.slot) : siftDown(event.slot);
+    }
+
+    updateNext();
+}
+
+void
+Scheduler::cancel(int id)
+{
+    assert(id >= 0 && id < (int)events.size());
+
+    if (events[id].slot >= 0) {
+
+        unlink(events[id].slot);
+        updateNext();
+    }
+}
+
+void
+Scheduler::cancelAll()
+{
+    for (auto id : heap) events[id].slot = -1;
+    heap.clear();
+    updateNext();
+}
+
+bool
+Scheduler::isPending(int id) const
+{
+    return id >= 0 && id < (int)events.size() && events[id].slot >= 0;
+}
+
+i64
+Scheduler::getTrigger(int id) const
+{
+    return isPending(id) ? events[id].trigger : INT64_MAX;
+}
+
+void
+Scheduler::serve(i64 clock)
+{
+    while (clock >= next) {
+
+        // Remove the earliest event from the heap
+        int id = heap[0];
+        served = events[id].trigger;
+        unlink(0);
+        updateNext();
+
+        /* Execute the callback (which may schedule new events). The callback
+         * is kept alive by a local reference, because it might add or remove
+         * events, which can reallocate or reset the event table.
+         */
+        auto callback = events[id].callback;
+        (*callback)();
+    }
+}
+
+void
+Scheduler::siftUp(int slot)
+{
+    int id = heap[slot];
+
+    while (slot > 0) {
+
+        int parent = (slot - 1) / 2;
+        if (events[heap[parent]].trigger <= events[id].trigger) break;
+
+        place(slot, heap[parent]);
+        slot = parent;
+    }
+    place(slot, id);
+}
+
+void
+Scheduler::siftDown(int slot)
+{
+    int id = heap[slot];
+    int size = (int)heap.size();
+
+    while (true) {
+
+        int child = 2 * slot + 1;
+        if (child >= size) break;
+
+        if (child + 1 < size && events[heap[child + 1]].trigger < events[heap[child]].trigger) {
+            child++;
+        }
+        if (events[id].trigger <= events[heap[child]].trigger) break;
+
+        place(slot, heap[child]);
+        slot = child;
+    }
+    place(slot, id);
+}
+
+void
+Scheduler::unlink(int slot)
+{
+    int id = heap[slot];
+    int last = heap.back();
+
+    heap.pop_back();
+    events[id].slot = -1;
+
+    if (id != last) {
+
+        // Move the last element into the gap and restore the heap property
+        place(slot, last);
+        siftUp(slot);
+        siftDown(events[last].slot);
+    }
+}
+
+}
@@ -0,0 +1,177 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+#include "MoiraSerialization.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace moira {
+
+/* Event scheduler
+ *
+ * The scheduler manages a set of events, each of which is triggered when the
+ * CPU clock reaches a certain cycle. Clients register an event source once by
+ * calling add(). Afterwards, the event can be scheduled, rescheduled, and
+ * canceled as often as needed. Pending events are kept in a binary min-heap.
+ * The trigger cycle of the earliest event is cached, which enables sync() to
+ * detect due events with a single comparison.
+ *
+ * Callbacks are executed inside sync(). They may schedule, reschedule, or
+ * cancel any event, including the one being served. They may also add or
+ * remove event sources. A callback stays alive until it returns, even if its
+ * own event source is removed.
+ *
+ * The trigger cycles of all events are part of the CPU snapshot. Callbacks
+ * are not. Events are matched in the order of their ids. Hence, a snapshot can
+ * only be restored if the same event sources have been registered in the same
+ * order. Internal events, which are registered by Moira's own components,
+ * are excluded. They are neither saved nor modified when a snapshot is
+ * restored. Enabling such a component does not change the snapshot layout.
+ */
+class Scheduler {
+
+public:
+
+    typedef std::function<void()> Callback;
+
+private:
+
+    struct Event {
+
+        // The function to call when the event triggers (shared with serve())
+        std::shared_ptr<const Callback> callback;
+
+        // The cycle in which the event triggers
+        i64 trigger = 0;
+
+        // Position in the heap (-1 if the event is not pending)
+        int slot = -1;
+
+        // Indicates if this entry is in use
+        bool used = false;
+
+        // Indicates if the event is excluded from snapshots
+        bool internal = false;
+    };
+
+    // All registered events (indexed by event id)
+    std::vector<Event> events;
+
+    // Min-heap of pending events (stores event ids)
+    std::vector<int> heap;
+
+    // Trigger cycle of the earliest pending event
+    i64 next = INT64_MAX;
+
+    // Trigger cycle of the event being served
+    i64 served = 0;
+
+
+    //
+    // Managing events
+    //
+
+public:
+
+    // Registers an event source and returns its id
+    int add(Callback callback, bool internal = false);
+
+    // Unregisters an event source
+    void remove(int id);
+
+    // Schedules an event (reschedules the event if it is already pending)
+    void schedule(int id, i64 cycle);
+
+    // Cancels a pending event
+    void cancel(int id);
+
+    // Cancels all pending events
+    void cancelAll();
+
+    // Checks if an event is pending
+    bool isPending(int id) const;
+
+    // Returns the trigger cycle of a pending event
+    i64 getTrigger(int id) const;
+
+    // Returns the trigger cycle of the earliest pending event
+    i64 nextTrigger() const { return next; }
+
+
+    //
+    // Serving events
+    //
+
+    // Checks if an event is due
+    bool isDue(i64 clock) const { return clock >= next; }
+
+    // Executes the callbacks of all due events
+    void serve(i64 clock);
+
+    // Returns the trigger cycle of the event being served (call from a callback)
+    i64 servedTrigger() const { return served; }
+
+
+    //
+    // Serializing
+    //
+
+    // Applies a serialization worker to the trigger cycles of all client events
+    template <class T> void serialize(T &worker);
+
+private:
+
+    // Restores the heap property
+    void siftUp(int slot);
+    void siftDown(int slot);
+
+    // Places an event at a certain heap position
+    void place(int slot, int id) { heap[slot] = id; events[id].slot = slot; }
+
+    // Removes the event at a certain heap position
+    void unlink(int slot);
+
+    // Updates the cached trigger cycle
+    void updateNext() { next = heap.empty() ? INT64_MAX : events[heap[0]].trigger; }
+
+    // Checks if an event is part of the snapshot
+    bool isSerialized(int id) const { return events[id].used && !events[id].internal; }
+};
+
+template <class T> void
+Scheduler::serialize(T &worker)
+{
+    u32 count = 0;
+    for (int id = 0; id < (int)events.size(); id++) count += isSerialized(id);
+    worker << count;
+
+    // Rebuild the heap when restoring (internal events stay where they are)
+    if constexpr (std::is_same_v<T, SerReader>) {
+        for (int id = 0; id < (int)events.size(); id++) if (!events[id].internal) cancel(id);
+    }
+
+    for (int id = 0; id < (int)events.size(); id++) {
+
+        if (!isSerialized(id)) continue;
+
+        bool pending = isPending(id);
+        i64 trigger = pending ? events[id].trigger : 0;
+        worker << pending << trigger;
+
+        if constexpr (std::is_same_v<T, SerReader>) {
+            if (pending) schedule(id, trigger);
+        }
+    }
+}
+
+}
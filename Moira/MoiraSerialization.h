@@ -0,0 +1,122 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+#include <cstddef>
+#include <type_traits>
+
+namespace moira {
+
+/* Serialization workers
+ *
+ * The CPU state is serialized by a single function template which applies a
+ * worker to all state variables in a fixed order. SerCounter determines the
+ * size of the serialized state, SerWriter stores the variables in a buffer,
+ * and SerReader restores them. All values are stored in little endian byte
+ * order with a fixed size, independent of the host architecture. The workers
+ * don't check the buffer bounds. The caller has to make sure that the buffer
+ * is large enough by consulting SerCounter beforehand.
+ *
+ * The workers only accept fixed-width integer types and bool. Variables of
+ * other types (int, enums) are wrapped with serAs<U>() which stores them as
+ * type U.
+ */
+
+template <class T> inline constexpr bool isSerializable =
+std::is_same_v<T, bool> ||
+std::is_same_v<T, u8> || std::is_same_v<T, u16> || std::is_same_v<T, u32> || std::is_same_v<T, u64> ||
+std::is_same_v<T, i8> || std::is_same_v<T, i16> || std::is_same_v<T, i32> || std::is_same_v<T, i64>;
+
+// Wraps a variable which is serialized as type U
+template <class U, class T> struct SerAs {
+
+    static_assert(isSerializable<U>, "Not a fixed-width type");
+    T &value;
+};
+
+template <class U, class T> SerAs<U, T> serAs(T &value) { return { value }; }
+
+class SerCounter {
+
+public:
+
+    // Number of bytes needed to serialize all processed variables
+    u32 count = 0;
+
+    template <class T> SerCounter& operator<<(T &) {
+
+        static_assert(isSerializable<T>, "Not a fixed-width type");
+        count += sizeof(T);
+        return *this;
+    }
+
+    template <class U, class T> SerCounter& operator<<(SerAs<U, T>) {
+
+        count += sizeof(U);
+        return *this;
+    }
+};
+
+class SerWriter {
+
+    u8 *ptr;
+
+public:
+
+    SerWriter(u8 *buffer) : ptr(buffer) { }
+
+    template <class T> SerWriter& operator<<(T &value) {
+
+        static_assert(isSerializable<T>, "Not a fixed-width type");
+        u64 v = u64(value);
+        for (size_t i = 0; i < sizeof(T); i++, v >>= 8) *ptr++ = u8(v);
+        return *this;
+    }
+
+    template <class U, class T> SerWriter& operator<<(SerAs<U, T> var) {
+
+        U v = U(var.value);
+        return *this << v;
+    }
+};
+
+class SerReader {
+
+    const u8 *ptr;
+
+public:
+
+    SerReader(const u8 *buffer) : ptr(buffer) { }
+
+    template <class T> SerReader& operator<<(T &value) {
+
+        static_assert(isSerializable<T>, "Not a fixed-width type");
+        u64 v = 0;
+        for (size_t i = 0; i < sizeof(T); i++) v |= u64(*ptr++) << (8 * i);
+
+        if constexpr (std::is_same_v<T, bool>) {
+            value = v != 0;
+        } else {
+            value = T(v);
+        }
+        return *this;
+    }
+
+    template <class U, class T> SerReader& operator<<(SerAs<U, T> var) {
+
+        U v;
+        *this << v;
+        var.value = T(v);
+        return *this;
+    }
+};
+
+}
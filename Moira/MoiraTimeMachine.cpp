@@ -0,0 +1,263 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "Moira.h"
+#include <stdexcept>
+
+namespace moira {
+
+void
+TimeMachine::setEnabled(bool value)
+{
+    enabled = value;
+    clear();
+
+    if (value) {
+
+        // Check if the client can restore unmapped memory by writing back a
+        // word of the upcoming instruction, which leaves the memory unchanged
+        u32 addr = moira.reg.pc0 & 0xFFFFFE;
+        moira.pokeIgnored = false;
+        moira.poke16(addr, u16(moira.inspect(addr, Word)));
+        canPoke = !moira.pokeIgnored;
+
+        moira.flags |= Moira::CPU_RECORD;
+
+    } else {
+        moira.flags &= ~Moira::CPU_RECORD;
+    }
+}
+
+void
+TimeMachine::clear()
+{
+    checkpoints.clear();
+    journal.clear();
+    journalBase = 0;
+    unrestorable = 0;
+    step = 0;
+}
+
+void
+TimeMachine::discard()
+{
+    checkpoints.clear();
+    journalBase += (i64)journal.size();
+    journal.clear();
+    unrestorable++;
+}
+
+std::optional<i64>
+TimeMachine::firstStep() const
+{
+    if (checkpoints.empty()) return { };
+    return checkpoints.front().step;
+}
+
+bool
+TimeMachine::seek(i64 target)
+{
+    if (!enabled) return false;
+
+    if (target < step) {
+
+        // Find the latest checkpoint preceding the target position
+        long nr = (long)checkpoints.size() - 1;
+        while (nr >= 0 && checkpoints[nr].step > target) nr--;
+        if (nr < 0) return false;
+
+        restore(nr);
+    }
+
+    return replay(target);
+}
+
+bool
+TimeMachine::seekToCycle(i64 cycle)
+{
+    if (!enabled) return false;
+
+    if (cycle < moira.clock) {
+
+        // Find the latest checkpoint preceding the target cycle
+        long nr = (long)checkpoints.size() - 1;
+        while (nr >= 0 && checkpoints[nr].clock > cycle) nr--;
+        if (nr < 0) return false;
+
+        restore(nr);
+    }
+
+    return replay(INT64_MAX, cycle);
+}
+
+bool
+TimeMachine::reverseContinue()
+{
+    if (!enabled) return false;
+
+    i64 origin = step, end = step;
+    horizon = origin;
+
+    // Search the history segment by segment, starting with the latest one
+    for (long nr = (long)checkpoints.size() - 1; nr >= 0; nr--) {
+
+        i64 begin = checkpoints[nr].step;
+        if (begin >= end) continue;
+
+        restore(nr);
+
+        hit = -1;
+        replay(end);
+
+        if (hit >= 0 && hit < origin) return seek(hit);
+        end = begin;
+    }
+
+    // Return to where we came from
+    seek(origin);
+    return false;
+}
+
+void
+TimeMachine::recordStep()
+{
+    if (checkpoints.empty() || moira.clock >= checkpoints.back().clock + interval) {
+
+        // Take a new checkpoint (unless one exists for this step)
+        if (checkpoints.empty() || checkpoints.back().step < step) {
+
+            // Make room by discarding the oldest checkpoint
+            if ((long)checkpoints.size() >= capacity) {
+
+                std::vector<u8> buffer = std::move(checkpoints.front().state);
+                checkpoints.pop_front();
+
+                i64 first = checkpoints.empty() ? journalBase + (i64)journal.size() : checkpoints.front().journal;
+                while (journalBase < first) { journal.pop_front(); journalBase++; }
+
+                checkpoints.push_back(Checkpoint { .state = std::move(buffer) });
+
+            } else {
+
+                checkpoints.push_back(Checkpoint { });
+            }
+
+            auto &checkpoint = checkpoints.back();
+            checkpoint.step = step;
+            checkpoint.clock = moira.clock;
+            checkpoint.journal = journalBase + (i64)journal.size();
+            checkpoint.state.resize(moira.stateSize());
+            moira.saveState(checkpoint.state);
+        }
+    }
+
+    step++;
+}
+
+void
+TimeMachine::recordWrite(u32 addr, Size S)
+{
+    addr &= 0xFFFFFF;
+
+    // The history ends here if the write can't be undone
+    if (!canPoke && !isMapped(addr, S)) { discard(); return; }
+
+    u32 value = moira.inspect(addr, S);
+    journal.push_back(Write { .addr = addr, .value = value, .size = u8(S) });
+}
+
+void
+TimeMachine::restore(long nr)
+{
+    auto &checkpoint = checkpoints[nr];
+
+    // Refuse to restore a checkpoint which doesn't match the scheduler setup
+    if (checkpoint.state.size() != moira.stateSize()) {
+        throw std::runtime_error("Event sources have been added or removed while recording");
+    }
+
+    // Roll back the journal
+    while (journalBase + (i64)journal.size() > checkpoint.journal) {
+
+        auto &entry = journal.back();
+        poke(entry.addr, Size(entry.size), entry.value);
+        journal.pop_back();
+    }
+
+    // Restore the CPU
+    moira.loadState(checkpoint.state);
+    step = checkpoint.step;
+
+    // Discard the future
+    checkpoints.resize(nr + 1);
+}
+
+bool
+TimeMachine::replay(i64 target, i64 cycle)
+{
+    replaying = true;
+
+    while (step < target && moira.clock < cycle && !(moira.flags & Moira::CPU_IS_HALTED)) {
+        moira.executeSlowPath();
+    }
+
+    replaying = false;
+    moira.flags &= ~Moira::CPU_DEBUG_EVENT;
+
+    return step >= target || moira.clock >= cycle;
+}
+
+bool
+TimeMachine::isMapped(u32 addr, Size S) const
+{
+    switch (S) {
+
+        case Byte: return moira.memoryMap.writePtr<Byte>(addr) != nullptr;
+        case Word: return moira.memoryMap.writePtr<Word>(addr) != nullptr;
+
+        default:
+
+            return isMapped(addr, Word) && isMapped((addr + 2) & 0xFFFFFF, Word);
+    }
+}
+
+void
+TimeMachine::poke(u32 addr, Size S, u32 value)
+{
+    switch (S) {
+
+        case Byte:
+
+            if (auto p = moira.memoryMap.writePtr<Byte>(addr)) {
+                p[0] = u8(value);
+            } else {
+                moira.poke8(addr, u8(value));
+            }
+            break;
+
+        case Word:
+
+            if (auto p = moira.memoryMap.writePtr<Word>(addr)) {
+                p[0] = u8(value >> 8);
+                p[1] = u8(value);
+            } else {
+                moira.poke16(addr, u16(value));
+            }
+            break;
+
+        default:
+
+            poke(addr, Word, value >> 16);
+            poke((addr + 2) & 0xFFFFFF, Word, value & 0xFFFF);
+            return;
+    }
+}
+
+}
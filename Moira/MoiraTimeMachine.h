@@ -0,0 +1,213 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+#include <deque>
+#include <optional>
+#include <vector>
+
+namespace moira {
+
+/* Time machine
+ *
+ * The time machine records the execution history of the CPU and allows the
+ * debugger to travel back in time. While recording is enabled, the CPU takes
+ * a checkpoint (a snapshot created by saveState()) in regular intervals and
+ * journals the old contents of all memory cells it writes to. To travel back,
+ * the journal is rolled back to the nearest checkpoint before the target, the
+ * checkpoint is restored, and the remaining instructions are replayed. Hence,
+ * the duration of a seek is bounded by the checkpoint interval.
+ *
+ * Positions in the history are measured in steps. A step is a single pass
+ * through the slow execution path, i.e., the execution of an instruction, the
+ * processing of an exception, or a single polling cycle in stopped state.
+ * Recording enforces the slow execution path for all instructions.
+ *
+ * Checkpoints include the trigger cycles of all client events of the scheduler,
+ * but not the state of the components owning them. Replaying is exact if the
+ * CPU is the only component modifying memory, if reads from unmapped memory and
+ * the IPL pins only depend on the clock, and if the event callbacks only depend
+ * on the clock and the CPU state. Delegates and scheduled events are triggered
+ * again during a replay. Event sources must not be added or removed while
+ * recording. A checkpoint taken with a different number of event sources is
+ * rejected with a std::runtime_error.
+ *
+ * Client event callbacks are executed again during a replay, because they
+ * usually drive the emulated hardware (e.g., by changing the IPL pins). Hence,
+ * a callback runs multiple times for the same emulated cycle if the CPU
+ * travels back and forth. Callbacks with external side effects (e.g., audio
+ * output) should check isReplaying() and skip these effects. Moira's own
+ * analysis tools (the instruction log, the tracer, the profiler, the sampler,
+ * the call graph, and the coverage map) don't record replayed instructions.
+ *
+ * Memory which is mapped in the memory map is journaled and restored
+ * directly. Unmapped memory is read via read16Dasm() and restored via
+ * poke8() and poke16(), which bypass the bus and must be free of side
+ * effects. The default implementations of poke8() and poke16() can't restore
+ * anything. This is checked once when recording is enabled by writing back a
+ * word at the current program counter. If the client doesn't override them, a
+ * write into an unmapped page (e.g., into a device register) can't be undone.
+ * In this case, the history recorded so far is discarded and recording
+ * continues with a new checkpoint. Hence, all positions before such a write
+ * are unreachable, and a partially restored state is never reported as a
+ * success. Unmapped device registers are never written while traveling in
+ * time.
+ */
+class TimeMachine {
+
+    // Reference to the connected CPU
+    class Moira &moira;
+
+    // Journal entry storing the old value of a memory cell
+    struct Write {
+
+        u32 addr;
+        u32 value;
+        u8 size;
+    };
+
+    // A snapshot of the CPU
+    struct Checkpoint {
+
+        i64 step;               // Position in the history
+        i64 clock;              // Clock at the time the checkpoint was taken
+        i64 journal;            // Journal size at the time the checkpoint was taken
+        std::vector<u8> state;  // CPU and scheduler state
+    };
+
+    // Indicates if the execution history is recorded
+    bool enabled = false;
+
+    // Number of cycles between two checkpoints
+    i64 interval = 100000;
+
+    // Maximum number of stored checkpoints
+    long capacity = 64;
+
+    // Recorded checkpoints (the oldest comes first)
+    std::deque<Checkpoint> checkpoints;
+
+    // Journal of overwritten memory cells
+    std::deque<Write> journal;
+
+    // Number of journal entries that have been discarded
+    i64 journalBase = 0;
+
+    // Current position in the history
+    i64 step = 0;
+
+    // Indicates if the time machine is replaying instructions
+    bool replaying = false;
+
+    // Indicates if poke8() and poke16() are implemented by the client
+    bool canPoke = false;
+
+    // Number of writes which couldn't be undone
+    i64 unrestorable = 0;
+
+    // Latest position before the horizon in which a debug event occurred
+    i64 hit = -1;
+    i64 horizon = 0;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    TimeMachine(Moira& ref) : moira(ref) { }
+
+
+    //
+    // Configuring
+    //
+
+    // Starts or stops recording (stopping discards the recorded history)
+    bool isEnabled() const { return enabled; }
+    void setEnabled(bool value);
+
+    // Sets the checkpoint interval in cycles
+    void setInterval(i64 cycles) { interval = cycles > 0 ? cycles : 1; }
+
+    // Sets the maximum number of stored checkpoints
+    void setCapacity(long value) { capacity = value > 1 ? value : 1; }
+
+    // Discards the recorded history
+    void clear();
+
+
+    //
+    // Inspecting the history
+    //
+
+    // Returns the current position
+    i64 getStep() const { return step; }
+
+    // Returns the oldest reachable position (if any)
+    std::optional<i64> firstStep() const;
+
+    // Indicates if the time machine is currently replaying instructions
+    bool isReplaying() const { return replaying; }
+
+    // Returns the number of writes which have cut off the history
+    i64 getUnrestorable() const { return unrestorable; }
+
+
+    //
+    // Traveling in time
+    //
+
+    // Moves to the specified position
+    bool seek(i64 target);
+
+    // Moves to the first step that begins at or after the specified cycle
+    bool seekToCycle(i64 cycle);
+
+    // Moves to the previous step
+    bool stepBack() { return step > 0 && seek(step - 1); }
+
+    // Moves to the latest previous position in which a debug event occurred
+    bool reverseContinue();
+
+
+    //
+    // Recording (called by the CPU)
+    //
+
+    // Called at the beginning of each step
+    void recordStep();
+
+    // Called prior to each write access
+    void recordWrite(u32 addr, Size S);
+
+    // Called instead of triggering a debug event during a replay
+    void recordHit() { if (step < horizon) hit = step; }
+
+private:
+
+    // Discards the history recorded so far (called if a write can't be undone)
+    void discard();
+
+    // Reverts the CPU and memory to the state of a checkpoint
+    void restore(long nr);
+
+    // Executes instructions until the position or the clock has been reached
+    bool replay(i64 target, i64 cycle = INT64_MAX);
+
+    // Writes memory without triggering any CPU activity
+    void poke(u32 addr, Size S, u32 value);
+
+    // Checks if a memory location is restored without calling poke8() or poke16()
+    bool isMapped(u32 addr, Size S) const;
+};
+
+}
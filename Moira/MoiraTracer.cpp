@@ -0,0 +1,215 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#include "MoiraConfig.h"
+#include "Moira.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace moira {
+
+Tracer::~Tracer()
+{
+    delete [] buffer;
+}
+
+void
+Tracer::setEnabled(bool value)
+{
+    enabled = value;
+
+    if (value) {
+
+        if (!buffer) setCapacity(16 * 1024 * 1024);
+        keyFrame = true;
+
+        moira.flags |= Moira::CPU_LOG_TRACE;
+
+    } else {
+
+        moira.flags &= ~Moira::CPU_LOG_TRACE;
+    }
+}
+
+void
+Tracer::setCapacity(size_t bytes)
+{
+    bytes = std::bit_ceil(std::max(bytes, 2 * maxEntrySize));
+
+    delete [] buffer;
+    buffer = new u8[bytes];
+    mask = bytes - 1;
+
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+
+    keyFrame = true;
+    last = { };
+}
+
+void
+Tracer::record()
+{
+    u64 h = head.load(std::memory_order_relaxed);
+
+    // Drop the entry if the buffer is full
+    if (mask + 1 - (h - tail.load(std::memory_order_acquire)) < maxEntrySize) {
+
+        dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        keyFrame = true;
+        return;
+    }
+
+    size_t pos = size_t(h & mask);
+    size_t size;
+
+    if (!keyFrame && pos + maxEntrySize <= mask + 1) {
+
+        // Encode in place
+        size = encode<false>(buffer + pos);
+
+    } else {
+
+        // Encode into a staging buffer and copy (the entry might wrap around)
+        u8 staging[maxEntrySize];
+        size = keyFrame ? encode<true>(staging) : encode<false>(staging);
+
+        size_t first = std::min(size, size_t(mask + 1) - pos);
+        memcpy(buffer + pos, staging, first);
+        memcpy(buffer, staging + first, size - first);
+        keyFrame = false;
+    }
+
+    head.store(h + size, std::memory_order_release);
+}
+
+template <bool key> size_t
+Tracer::encode(u8 *entry)
+{
+    auto &reg = moira.reg;
+    u8 *p = entry + 1;
+    u8 tag = key ? 16 : 0;
+
+    auto write16 = [&](u16 value) { memcpy(p, &value, 2); p += 2; };
+    auto write32 = [&](u32 value) { memcpy(p, &value, 4); p += 4; };
+
+    // Clock
+    u64 delta = u64(moira.clock - (key ? 0 : clock));
+    u64 zigzag = (delta << 1) ^ u64(i64(delta) >> 63);
+    for (; zigzag >= 0x80; zigzag >>= 7) *p++ = u8(zigzag | 0x80);
+    *p++ = u8(zigzag);
+    clock = moira.clock;
+
+    // Program counter
+    i32 offset = i32(reg.pc0 - pc);
+    if (!key && u32(offset + 256) <= 510 && !(offset & 1)) {
+
+        *p++ = u8(offset >> 1);
+
+    } else if (!key && u32(offset + 32768) <= 65535) {
+
+        tag |= 1;
+        write16(u16(offset));
+
+    } else {
+
+        tag |= 2;
+        write32(reg.pc0);
+    }
+    pc = reg.pc0;
+
+    // Status register
+    u16 newsr = moira.getSR();
+    if (key || newsr != sr) {
+
+        tag |= 4;
+        write16(newsr);
+        sr = newsr;
+    }
+
+    // Data and address registers
+    u32 changed = 0;
+    for (int i = 0; i < 16; i++) changed |= u32(reg.r[i] != r[i]) << i;
+    if (key) changed = 0xFFFF;
+
+    if (changed) {
+
+        tag |= 8;
+        write16(u16(changed));
+        for (; changed; changed &= changed - 1) {
+
+            int i = std::countr_zero(changed);
+            write32(reg.r[i]);
+            r[i] = reg.r[i];
+        }
+    }
+
+    entry[0] = tag;
+    return size_t(p - entry);
+}
+
+size_t
+Tracer::drain(std::span<TraceEntry> entries)
+{
+    u64 t = tail.load(std::memory_order_relaxed);
+    u64 h = head.load(std::memory_order_acquire);
+
+    auto read = [&](void *dst, size_t size) {
+        for (size_t i = 0; i < size; i++) ((u8 *)dst)[i] = buffer[t++ & mask];
+    };
+    auto read8 = [&]() { return buffer[t++ & mask]; };
+    auto read16 = [&]() { u16 value; read(&value, 2); return value; };
+    auto read32 = [&]() { u32 value; read(&value, 4); return value; };
+
+    size_t count = 0;
+    for (; t != h && count < entries.size(); count++) {
+
+        u8 tag = read8();
+        bool key = tag & 16;
+
+        TraceEntry entry = key ? TraceEntry { } : last;
+        entry.keyFrame = key;
+
+        // Clock
+        u64 zigzag = 0;
+        for (int shift = 0;; shift += 7) {
+
+            u8 byte = read8();
+            zigzag |= u64(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        entry.clock += i64((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+
+        // Program counter
+        switch (tag & 3) {
+
+            case 0:  entry.pc += u32(i32(i8(read8())) * 2); break;
+            case 1:  entry.pc += u32(i32(i16(read16()))); break;
+            default: entry.pc = read32(); break;
+        }
+
+        // Status register
+        if (tag & 4) entry.sr = read16();
+
+        // Data and address registers
+        if (tag & 8) {
+
+            u16 changed = read16();
+            for (int i = 0; i < 16; i++) if (changed & (1 << i)) entry.r[i] = read32();
+        }
+
+        entries[count] = last = entry;
+    }
+
+    tail.store(t, std::memory_order_release);
+    return count;
+}
+
+}
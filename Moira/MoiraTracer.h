@@ -0,0 +1,146 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "MoiraTypes.h"
+#include <atomic>
+#include <cstddef>
+#include <span>
+
+namespace moira {
+
+struct TraceEntry {
+
+    i64 clock;              // Cycle in which the instruction has been started
+    u32 pc;                 // Beginning of the instruction (pc0)
+    u16 sr;                 // Status register
+    u32 r[16];              // D0, D1 ... D7, A0, A1 ... A7
+    bool keyFrame;          // Indicates a key frame (entries may have been dropped before)
+};
+
+/* Instruction tracer
+ *
+ * If enabled, the tracer records the register contents at the beginning of
+ * each executed instruction. In contrast to the log buffer of the debugger,
+ * which stores a full copy of the register set, each entry only stores what
+ * has changed since the previous entry. An entry is encoded as follows:
+ *
+ *     Tag byte:        Bits 0-1: Encoding of the program counter
+ *                                0: Signed delta divided by 2 (1 byte)
+ *                                1: Signed delta (2 bytes)
+ *                                2: Absolute value (4 bytes)
+ *                      Bit 2:    Status register follows
+ *                      Bit 3:    Register mask follows
+ *                      Bit 4:    Key frame
+ *     Clock:           Zigzag-encoded delta (varint), absolute in key frames
+ *     Program counter: As specified by the tag byte
+ *     Status register: 2 bytes (if present)
+ *     Register mask:   2 bytes, bit n refers to r[n] (if present)
+ *     Registers:       4 bytes for each register listed in the mask
+ *
+ * Multi-byte values are stored in host byte order, as the buffer is decoded
+ * by the same process.
+ *
+ * A key frame stores all registers and the status register. It is written
+ * for the first entry and after entries had to be dropped.
+ *
+ * The entries are stored in a preallocated ring buffer of bytes. The CPU
+ * thread is the only producer. A single consumer thread can drain and decode
+ * the buffer concurrently. If the buffer is full, new entries are dropped.
+ */
+class Tracer {
+
+    // Reference to the connected CPU
+    class Moira &moira;
+
+    // Upper bound for the size of a single entry
+    static constexpr size_t maxEntrySize = 1 + 10 + 4 + 2 + 2 + 64;
+
+    // The ring buffer (the capacity is a power of two)
+    u8 *buffer = nullptr;
+    u64 mask = 0;
+
+    // Read and write positions in bytes (only increase)
+    alignas(64) std::atomic<u64> head = 0;
+    alignas(64) std::atomic<u64> tail = 0;
+
+    // Number of entries that have been dropped because the buffer was full
+    std::atomic<i64> dropped = 0;
+
+    // Previously recorded values (producer side)
+    i64 clock = 0;
+    u32 pc = 0;
+    u16 sr = 0;
+    u32 r[16] = { };
+
+    // Indicates that the next entry must be written as a key frame
+    bool keyFrame = true;
+
+    // Previously decoded entry (consumer side)
+    TraceEntry last = { };
+
+    // Indicates if tracing is enabled
+    bool enabled = false;
+
+
+    //
+    // Constructing
+    //
+
+public:
+
+    Tracer(Moira& ref) : moira(ref) { }
+    ~Tracer();
+
+
+    //
+    // Configuring (call from the CPU thread only)
+    //
+
+    // Starts or stops tracing
+    bool isEnabled() const { return enabled; }
+    void setEnabled(bool value);
+
+    /* Allocates a ring buffer of the specified size in bytes
+     *
+     * The capacity is rounded up to the next power of two. All entries that
+     * have not been drained are discarded. Must not be called while a
+     * consumer is draining the buffer.
+     */
+    void setCapacity(size_t bytes);
+
+
+    //
+    // Recording (called by the CPU)
+    //
+
+    void record();
+
+
+    //
+    // Consuming entries (call from a single consumer thread)
+    //
+
+    // Decodes up to entries.size() entries into the provided buffer
+    size_t drain(std::span<TraceEntry> entries);
+
+    // Returns the number of bytes waiting to be drained
+    size_t pending() const { return size_t(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)); }
+
+    // Returns the number of dropped entries
+    i64 getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+
+    // Encodes a single entry and returns its size
+    template <bool key> size_t encode(u8 *entry);
+};
+
+}
@@ -211,6 +211,14 @@ typedef struct
 }
 InstrInfo;
 
+typedef enum
+{
+    HOOK_NONE           = 0,
+    HOOK_WILL_EXECUTE   = 1,    // Call willExecute() before the instruction
+    HOOK_DID_EXECUTE    = 2     // Call didExecute() after the instruction
+}
+ExecHook;
+
 typedef enum
 {
     IRQ_AUTO,
@@ -302,6 +310,12 @@ struct PrefetchQueue {
     u16 ird;                // The instruction currently being executed
 };
 
+struct RunStats {
+    
+    i64 instructions;       // Number of executed instructions
+    i64 cycles;             // Number of elapsed cycles
+};
+
 /* Execution flags
  *
  * The M68k is a well organized processor that breaks down the execution of
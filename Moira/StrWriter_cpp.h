@@ -9,7 +9,7 @@
 
 #include <cmath>
 
-static const char *mnemonics[]
+static const char *const mnemonics[]
 {
     // 68000
     "abcd" ,    "add",      "adda",     "addi",     "addq",     "addx",
@@ -0,0 +1,47 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "Moira.h"
+
+using namespace moira;
+
+/* CPU used by the bus tests
+ *
+ * The bus tests compile Moira with MOIRA_BUS set to this class. Hence, Moira
+ * calls the memory interface of this class directly instead of going through
+ * the virtual function table.
+ */
+class BusCPU : public Moira {
+
+    friend class Moira;
+
+public:
+
+    u8 mem[0x10000] = { };
+
+    // Number of calls to the memory interface
+    long reads = 0;
+    long writes = 0;
+    long syncs = 0;
+
+    u16 peek16(u32 addr) const {
+        return u16(mem[addr & 0xFFFF] << 8 | mem[(addr + 1) & 0xFFFF]); }
+    void store16(u32 addr, u16 val) {
+        mem[addr & 0xFFFF] = u8(val >> 8); mem[(addr + 1) & 0xFFFF] = u8(val); }
+
+protected:
+
+    void sync(int cycles) override { syncs++; Moira::sync(cycles); }
+    u8 read8(u32 addr) override { reads++; return mem[addr & 0xFFFF]; }
+    u16 read16(u32 addr) override { reads++; return peek16(addr); }
+    void write8(u32 addr, u8 val) override { writes++; mem[addr & 0xFFFF] = val; }
+    void write16(u32 addr, u16 val) override { writes++; store16(addr, val); }
+};
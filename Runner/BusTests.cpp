@@ -0,0 +1,72 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+/* Bus tests
+ *
+ * This program is linked against a copy of the CPU core which has been
+ * compiled with MOIRA_BUS set to BusCPU. It checks that the core calls the
+ * memory interface of BusCPU directly. The program terminates with a non-zero
+ * exit code if a check fails.
+ */
+
+#include "BusCPU.h"
+#include <stdio.h>
+
+// Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) { if (!(cond)) { \
+printf("%s:%d: Check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } }
+
+// A subclass whose memory interface is bypassed by the static binding
+class DerivedCPU : public BusCPU {
+
+public:
+
+    long derivedReads = 0;
+
+protected:
+
+    u16 read16(u32 addr) override { derivedReads++; return BusCPU::read16(addr); }
+};
+
+int main(int argc, char **argv)
+{
+    DerivedCPU cpu;
+
+    // Counts up D0 and writes it to memory (see UnitTests.cpp)
+    u16 program[] = { 0x7000, 0x5280, 0x33C0, 0x0000, 0x2000, 0x60F6 };
+
+    cpu.store16(2, 0x8000);
+    cpu.store16(6, 0x1000);
+    for (int i = 0; i < 6; i++) cpu.store16(0x1000 + 2 * i, program[i]);
+
+    // Reset fetches the vectors via the virtual read16OnReset()
+    cpu.reset();
+    cpu.derivedReads = 0;
+    cpu.run(10000);
+
+    // The CPU runs as usual
+    CHECK(cpu.getD(0) > 0);
+    CHECK(cpu.peek16(0x2000) == u16(cpu.getD(0)));
+    CHECK(cpu.reads > 0 && cpu.writes > 0 && cpu.syncs > 0);
+
+    // The instruction handlers call BusCPU directly
+    CHECK(cpu.derivedReads == 0);
+
+    // Other functions still use virtual calls (read16Dasm() calls read16())
+    char str[128];
+    cpu.disassemble(0x1002, str);
+    CHECK(cpu.derivedReads > 0);
+
+    if (failures) printf("%d check(s) failed\n", failures);
+    else printf("All checks passed\n");
+
+    return failures ? 1 : 0;
+}
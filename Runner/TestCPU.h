@@ -15,6 +15,8 @@ using namespace moira;
 
 class TestCPU : public Moira {
 
+    friend class Moira;
+
     void sync(int cycles) override;
     u8 read8(u32 addr) override;
     u16 read16(u32 addr) override;
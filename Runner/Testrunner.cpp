@@ -10,6 +10,9 @@
 #include "config.h"
 #include "Testrunner.h"
 #include "m68k_disasm.h"
+#include <chrono>
+#include <spawn.h>
+#include <sys/wait.h>
 
 TestCPU *moiracpu;
 Sandbox sandbox;
@@ -19,6 +22,7 @@ u8 moiraMem[0x10000];
 u32 musashiFC = 0;
 long testrun = 0;
 moira::Model cpuModel = M68000;
+const char *executable = nullptr;
 // int cpuType = 0;
 
 // M68k disassembler
@@ -200,6 +204,10 @@ void run()
     printf("The test program runs Moira agains Musashi with randomly generated data.\n");
     printf("It runs until a bug has been found.\n");
 
+    if constexpr (PROFILE_STARTUP) profileStartup();
+    if constexpr (PROFILE_TIMING) profileTiming();
+    if constexpr (PROFILE_SAMPLER) profileSampler();
+
     selectModel(M68EC030);
     srand(3);
 
@@ -251,6 +259,151 @@ void run()
     }
 }
 
+void profileStartup()
+{
+    const int runs = 100;
+    const int processes = 100;
+
+    clock_t elapsed = clock();
+
+    for (int i = 0; i < runs; i++) {
+
+        TestCPU cpu;
+        for (int m = M68000; m <= M68030; m++) cpu.setModel(Model(m));
+    }
+
+    elapsed = clock() - elapsed;
+
+    printf("\nStartup time: %.2fus per CPU (including all model switches, average of %d runs)\n",
+           1000000.0 * elapsed / double(CLOCKS_PER_SEC) / runs, runs);
+
+    // Measure the time of a complete process run (including the loader)
+    char option[] = "--startup";
+    char *args[] = { (char *)executable, option, nullptr };
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < processes; i++) {
+
+        pid_t pid;
+        int status;
+
+        // Skip the measurement if the process can't be launched
+        if (int error = posix_spawn(&pid, executable, nullptr, nullptr, args, nullptr)) {
+
+            printf("Failed to launch %s (%s). Skipping process measurement.\n",
+                   executable, strerror(error));
+            return;
+        }
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+
+            printf("%s did not exit cleanly. Skipping process measurement.\n", executable);
+            return;
+        }
+    }
+
+    std::chrono::duration<double, std::micro> total =
+    std::chrono::steady_clock::now() - start;
+
+    printf("Process startup time: %.2fus per process (average of %d runs)\n",
+           total.count() / processes, processes);
+}
+
+// A CPU with its own memory which runs a small benchmark loop
+//
+//     1000: moveq   #0,d0
+//     1002: addq.l  #1,d0
+//     1004: move.l  d0,$2000
+//     100a: move.l  $2000,d1
+//     1010: bra.s   $1002
+class ProfileCPU : public Moira {
+
+    u8 mem[0x10000] = { };
+
+    u8 read8(u32 addr) override { return get8(mem, addr); }
+    u16 read16(u32 addr) override { return get16(mem, addr); }
+    void write8(u32 addr, u8 val) override { set8(mem, addr, val); }
+    void write16(u32 addr, u16 val) override { set16(mem, addr, val); }
+
+public:
+
+    ProfileCPU() {
+
+        const u16 program[] = { 0x7000, 0x5280, 0x23C0, 0x0000, 0x2000, 0x2239, 0x0000, 0x2000, 0x60F0 };
+
+        set16(mem, 2, 0x8000);
+        set16(mem, 6, 0x1000);
+        for (u32 i = 0; i < sizeof(program) / 2; i++) set16(mem, 0x1000 + 2 * i, program[i]);
+
+        reset();
+    }
+
+    // Runs the benchmark loop and returns the best of five times in seconds
+    double measure(i64 cycles) {
+
+        double best = 0;
+
+        for (int i = 0; i < 5; i++) {
+
+            auto start = std::chrono::steady_clock::now();
+            run(cycles);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (i == 0 || elapsed.count() < best) best = elapsed.count();
+        }
+        return best;
+    }
+};
+
+void profileTiming()
+{
+    const i64 cycles = 100000000;
+
+    ProfileCPU fast, precise;
+    fast.setPreciseTiming(false);
+    precise.setPreciseTiming(true);
+
+    double t1 = fast.measure(cycles);
+    printf("\nFast timing:    %.2fs\n", t1);
+
+    if (!precise.getPreciseTiming()) {
+
+        printf("Precise timing: Not compiled in (PRECISE_TIMING is false)\n");
+        return;
+    }
+
+    double t2 = precise.measure(cycles);
+    printf("Precise timing: %.2fs (%+.1f%%)\n", t2, 100.0 * (t2 - t1) / t1);
+}
+
+void profileSampler()
+{
+    const i64 cycles = 100000000;
+
+    ProfileCPU plain;
+    double t1 = plain.measure(cycles);
+    printf("\nWithout sampler:             %.2fs\n", t1);
+
+    for (i64 interval : { 10000, 1000, 100 }) {
+
+        ProfileCPU cpu;
+        cpu.sampler.setCapacity(1 << 20);
+        cpu.sampler.setInterval(interval);
+        cpu.sampler.setEnabled(true);
+
+        double t2 = cpu.measure(cycles);
+        printf("Sampling every %5lld cycles: %.2fs (%+.1f%%)\n",
+               (long long)interval, t2, 100.0 * (t2 - t1) / t1);
+    }
+}
+
+int startProcess()
+{
+    TestCPU cpu;
+    for (int m = M68000; m <= M68030; m++) cpu.setModel(Model(m));
+
+    return 0;
+}
+
 void runSingleTest(Setup &s)
 {
     Result mur, mor;
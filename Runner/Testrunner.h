@@ -41,6 +41,7 @@ extern u8 moiraMem[0x10000];
 extern u32 musashiFC;
 extern long testrun;
 extern moira::Model cpuModel;
+extern const char *executable;
 
 inline u8 get8(u8 *p, u32 addr) {
     return p[addr & 0xFFFF];
@@ -132,6 +133,11 @@ void resetMoira(Setup &s);
 
 void run();
 
+void profileStartup();
+void profileTiming();
+void profileSampler();
+int startProcess();
+
 void runSingleTest(Setup &s);
 
 void runM68k(Setup &s, Result &r);
@@ -0,0 +1,1599 @@
+// -----------------------------------------------------------------------------
+// This file is part of Moira - A Motorola 68k emulator
+//
+// Copyright (C) Dirk W. Hoffmann. www.dirkwhoffmann.de
+// Licensed under the GNU General Public License v3
+//
+// See https://www.gnu.org for license information
+// -----------------------------------------------------------------------------
+
+/* Unit tests
+ *
+ * In contrast to the test runner, which compares Moira against Musashi on
+ * randomly generated instructions, the unit tests check the emulator
+ * extensions (scheduler, snapshots, debugger, profilers, etc.) on small
+ * hand-assembled programs. The program terminates with a non-zero exit code
+ * if a check fails.
+ */
+
+#include "MoiraConfig.h"
+#include "Moira.h"
+#include "MoiraBatchRunner.h"
+#include <stdio.h>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace moira;
+
+// Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) { if (!(cond)) { \
+printf("%s:%d: Check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } }
+
+#define CHECK_THROWS(expr) { try { expr; \
+printf("%s:%d: No exception: %s\n", __FILE__, __LINE__, #expr); failures++; } \
+catch (const std::runtime_error &) { } }
+
+// Counts up D0 and writes it to memory
+//
+//     1000: moveq   #0,d0
+//     1002: addq.l  #1,d0
+//     1004: move.w  d0,$2000
+//     100a: bra.s   $1002
+static const std::vector<u16> counterProgram = {
+
+    0x7000, 0x5280, 0x33C0, 0x0000, 0x2000, 0x60F6
+};
+
+class UnitCPU : public Moira {
+
+public:
+
+    u8 mem[0x10000] = { };
+
+    // Number of write accesses which have reached the bus
+    long busWrites = 0;
+
+    // Function code of the latest write access
+    FunctionCode writeFC = FunctionCode(0);
+
+    // Number of calls to sync()
+    long syncs = 0;
+
+    // Number of long word accesses which have reached the bus
+    long reads32 = 0;
+    long writes32 = 0;
+
+    // Recorded debugger events
+    long breakpoints = 0;
+    long watchpoints = 0;
+
+    // Recorded instruction delegates
+    std::vector<std::string> will;
+    std::vector<std::string> did;
+
+    // Loads a program to $1000 and resets the CPU
+    UnitCPU(const std::vector<u16> &program = counterProgram) {
+
+        poke16(0, 0x0000);
+        poke16(2, 0x8000);
+        poke16(4, 0x0000);
+        poke16(6, 0x1000);
+
+        for (size_t i = 0; i < program.size(); i++) poke16(u32(0x1000 + 2 * i), program[i]);
+
+        reset();
+        setClock(0);
+    }
+
+    u16 peek16(u32 addr) const {
+        return u16(mem[addr & 0xFFFF] << 8 | mem[(addr + 1) & 0xFFFF]); }
+    void store8(u32 addr, u8 val) {
+        mem[addr & 0xFFFF] = val; }
+    void store16(u32 addr, u16 val) {
+        mem[addr & 0xFFFF] = u8(val >> 8); mem[(addr + 1) & 0xFFFF] = u8(val); }
+    void poke8(u32 addr, u8 val) override { store8(addr, val); }
+    void poke16(u32 addr, u16 val) override { store16(addr, val); }
+
+    // Executes instructions until the clock has reached the specified cycle
+    void executeUntil(i64 cycle) { while (clock < cycle) execute(); }
+
+    // Checks if the sampler has routed execution through the slow path
+    bool isSampling() const { return flags & CPU_SAMPLE; }
+
+    // Returns the jump table of the selected CPU model
+    auto jumpTable() const { return exec; }
+
+private:
+
+    u8 read8(u32 addr) override { return mem[addr & 0xFFFF]; }
+    u16 read16(u32 addr) override { return peek16(addr); }
+    void write8(u32 addr, u8 val) override { busWrites++; writeFC = readFC(); store8(addr, val); }
+    void write16(u32 addr, u16 val) override { busWrites++; writeFC = readFC(); store16(addr, val); }
+    u32 read32(u32 addr) override { reads32++; return Moira::read32(addr); }
+    void write32(u32 addr, u32 val) override { writes32++; Moira::write32(addr, val); }
+    void sync(int cycles) override { syncs++; Moira::sync(cycles); }
+
+    void breakpointReached(u32 addr) override { breakpoints++; }
+    void watchpointReached(u32 addr) override { watchpoints++; }
+
+    void willExecute(const char *func, Instr I, Mode M, Size S, u16 opcode) override {
+        will.push_back(func); }
+    void didExecute(const char *func, Instr I, Mode M, Size S, u16 opcode) override {
+        did.push_back(func); }
+};
+
+//
+// Running the CPU
+//
+
+static void testRun()
+{
+    UnitCPU cpu, ref;
+
+    // run() stops at the first instruction boundary after the deadline
+    auto stats = cpu.run(1000);
+    CHECK(stats.cycles >= 1000 && stats.cycles < 1000 + 16);
+    CHECK(stats.cycles == cpu.getClock());
+
+    i64 count = 0;
+    for (; ref.getClock() < 1000; count++) ref.execute();
+    CHECK(stats.instructions == count);
+    CHECK(cpu.getClock() == ref.getClock());
+    CHECK(cpu.getD(0) == ref.getD(0));
+    CHECK(cpu.getPC0() == ref.getPC0());
+
+    // runUntil() continues at the current clock
+    cpu.runUntil(5000);
+    CHECK(cpu.getClock() >= 5000 && cpu.getClock() < 5000 + 16);
+    CHECK(cpu.peek16(0x2000) == u16(cpu.getD(0)));
+}
+
+//
+// Sharing jump tables
+//
+
+static void testJumpTables()
+{
+    UnitCPU a, b;
+
+    // All instances of a CPU model share the same tables
+    CHECK(a.jumpTable() == b.jumpTable());
+
+    // Switching the model switches the tables
+    b.setModel(M68010);
+    CHECK(a.jumpTable() != b.jumpTable());
+    CHECK(a.getInfo(0x4E7A).I == ILLEGAL);
+    CHECK(b.getInfo(0x4E7A).I == MOVEC);
+
+    a.setModel(M68010);
+    CHECK(a.jumpTable() == b.jumpTable());
+
+    // The EC variants use the tables of the full models
+    a.setModel(M68EC020);
+    b.setModel(M68020);
+    CHECK(a.jumpTable() == b.jumpTable());
+    a.setModel(M68EC030);
+    CHECK(a.jumpTable() != b.jumpTable());
+    b.setModel(M68030);
+    CHECK(a.jumpTable() == b.jumpTable());
+
+    // A CPU continues to run with the tables of the new model
+    UnitCPU ref;
+    a.setModel(M68000);
+    a.run(1000);
+    ref.run(1000);
+    CHECK(a.getD(0) == ref.getD(0));
+    CHECK(a.getClock() == ref.getClock());
+}
+
+//
+// Generating jump tables at compile time
+//
+
+static void testJumpTableEntries()
+{
+    UnitCPU cpu;
+    char str[128];
+
+    for (Model model : { M68000, M68010, M68020, M68030 }) {
+
+        cpu.setModel(model);
+
+        auto addq = cpu.getInfo(0x5280);
+        CHECK(addq.I == ADDQ && addq.M == MODE_DN && addq.S == Long);
+        auto move = cpu.getInfo(0x33C0);
+        CHECK(move.I == MOVE && move.M == MODE_DN && move.S == Word);
+        CHECK(cpu.getInfo(0x60F6).I == BRA);
+        CHECK(cpu.getInfo(0x4E75).I == RTS);
+        CHECK(cpu.getInfo(0xA000).I == LINE_A);
+
+        // Instructions which have been added with the 68020
+        CHECK(cpu.getInfo(0x49C0).I == (model >= M68020 ? EXTB : ILLEGAL));
+
+        // The disassembler handlers are registered alongside
+        cpu.disassemble(0x1002, str);
+        CHECK(strcmp(str, "addq.l  #$1, D0") == 0);
+    }
+}
+
+//
+// Mapping host memory
+//
+
+static void testMemoryMap()
+{
+    UnitCPU cpu, ref;
+
+    // Accesses to mapped pages bypass the virtual functions, but not the timing
+    cpu.memoryMap.mapRam(0x0000, 0xFFFF, cpu.mem);
+    cpu.run(10000);
+    ref.run(10000);
+
+    CHECK(cpu.getClock() == ref.getClock());
+    CHECK(cpu.getD(0) == ref.getD(0));
+    CHECK(cpu.peek16(0x2000) == ref.peek16(0x2000));
+
+    // Unmapped pages are handled by the virtual functions again
+    cpu.memoryMap.unmap(0x2000, 0x2FFF);
+    cpu.run(1000);
+    CHECK(cpu.peek16(0x2000) == u16(cpu.getD(0)));
+}
+
+//
+// Accessing long words
+//
+
+// Writes and reads a long word and a word
+//
+//     1000: move.l  d0,$2000
+//     1006: move.l  $2000,d1
+//     100c: move.w  d0,$2004
+//     1012: move.w  $2004,d2
+//     1018: bra.s   $1018
+static const std::vector<u16> longProgram = {
+
+    0x23C0, 0x0000, 0x2000, 0x2239, 0x0000, 0x2000,
+    0x33C0, 0x0000, 0x2004, 0x3439, 0x0000, 0x2004, 0x60FE
+};
+
+static void testLongAccess()
+{
+    // Long words are split up if precise timing or address errors are compiled in
+    if constexpr (!PRECISE_TIMING && !EMULATE_ADDRESS_ERROR) {
+
+        UnitCPU cpu(longProgram);
+        cpu.setD(0, 0x12345678);
+
+        // Each long word access reaches the bus with a single call
+        cpu.execute();
+        CHECK(cpu.writes32 == 1 && cpu.busWrites == 2);
+        cpu.execute();
+        CHECK(cpu.reads32 == 1);
+        CHECK(cpu.getD(1) == 0x12345678);
+
+        // Word accesses don't call the long word functions
+        cpu.execute();
+        cpu.execute();
+        CHECK(cpu.reads32 == 1 && cpu.writes32 == 1);
+        CHECK(cpu.getD(2) == 0x5678);
+    }
+}
+
+//
+// Switching the emulation accuracy
+//
+
+// Reads a word from an odd address
+//
+//     1000: move.w  $2001,d1
+//     1006: bra.s   $1006
+//     1100: bra.s   $1100       (address error handler)
+static const std::vector<u16> oddProgram = {
+
+    0x3239, 0x0000, 0x2001, 0x60FE
+};
+
+static void testAccuracy()
+{
+    // Features which are not compiled in can't be enabled
+    {   UnitCPU cpu;
+
+        cpu.setPreciseTiming(true);
+        cpu.setAddressErrors(true);
+        cpu.setFunctionCodes(true);
+        CHECK(cpu.getPreciseTiming() == PRECISE_TIMING);
+        CHECK(cpu.getAddressErrors() == EMULATE_ADDRESS_ERROR);
+        CHECK(cpu.getFunctionCodes() == EMULATE_FC);
+    }
+
+    // Precise timing syncs at each bus access, but the CPUs run in lockstep
+    if constexpr (PRECISE_TIMING) {
+
+        UnitCPU precise, fast;
+        precise.setPreciseTiming(true);
+        fast.setPreciseTiming(false);
+
+        for (int i = 0; i < 100; i++) { precise.execute(); fast.execute(); }
+        CHECK(precise.getClock() == fast.getClock());
+        CHECK(precise.syncs > fast.syncs);
+    }
+
+    // An address error is only raised if enabled
+    if constexpr (EMULATE_ADDRESS_ERROR) {
+
+        for (bool enabled : { false, true }) {
+
+            UnitCPU cpu(oddProgram);
+            cpu.poke16(0x0E, 0x1100);
+            cpu.poke16(0x1100, 0x60FE);
+            cpu.setAddressErrors(enabled);
+            cpu.reset();
+            cpu.run(1000);
+            CHECK((cpu.getPC0() == 0x1100) == enabled);
+        }
+    }
+
+    // The function code pins are only updated if enabled
+    if constexpr (EMULATE_FC) {
+
+        for (bool enabled : { false, true }) {
+
+            UnitCPU cpu;
+            cpu.setFunctionCodes(enabled);
+            cpu.reset();
+            cpu.run(1000);
+            CHECK((cpu.writeFC == FC_SUPERVISOR_DATA) == enabled);
+        }
+    }
+}
+
+//
+// Scheduling events
+//
+
+static void testScheduler()
+{
+    UnitCPU cpu;
+    std::vector<i64> fired;
+
+    // Events are served in the order of their trigger cycles
+    int a = cpu.scheduler.add([&]() { fired.push_back(1); });
+    int b = cpu.scheduler.add([&]() { fired.push_back(2); });
+    cpu.scheduler.schedule(a, 300);
+    cpu.scheduler.schedule(b, 200);
+    CHECK(cpu.scheduler.nextTrigger() == 200);
+    cpu.run(1000);
+    CHECK((fired == std::vector<i64> { 2, 1 }));
+    CHECK(!cpu.scheduler.isPending(a) && !cpu.scheduler.isPending(b));
+
+    // Rescheduling and canceling
+    fired.clear();
+    cpu.scheduler.schedule(a, cpu.getClock() + 500);
+    cpu.scheduler.schedule(a, cpu.getClock() + 100);
+    cpu.scheduler.schedule(b, cpu.getClock() + 200);
+    cpu.scheduler.cancel(b);
+    CHECK(cpu.scheduler.getTrigger(b) == INT64_MAX);
+    cpu.run(1000);
+    CHECK((fired == std::vector<i64> { 1 }));
+
+    // A periodic event reschedules itself
+    int ticks = 0, periodic = -1;
+    periodic = cpu.scheduler.add([&]() {
+        if (++ticks < 5) cpu.scheduler.schedule(periodic, cpu.scheduler.servedTrigger() + 100);
+    });
+    cpu.scheduler.schedule(periodic, cpu.getClock() + 100);
+    cpu.run(1000);
+    CHECK(ticks == 5);
+}
+
+static void testSchedulerCallbacks()
+{
+    UnitCPU cpu;
+    std::vector<std::string> log;
+    int self = -1, other = -1;
+
+    // A callback which removes its own event source and adds new ones
+    self = cpu.scheduler.add([&, name = std::string(100, 'x')]() {
+
+        // Grow the event table (the callback must not be moved or freed)
+        for (int i = 0; i < 64; i++) cpu.scheduler.add([]() { });
+
+        // Remove this event source and reuse its id
+        cpu.scheduler.remove(self);
+        other = cpu.scheduler.add([&]() { log.push_back("other"); });
+        cpu.scheduler.schedule(other, cpu.getClock() + 100);
+
+        // Access the captured state after the event table has changed
+        log.push_back(name);
+    });
+
+    cpu.scheduler.schedule(self, 500);
+    cpu.run(2000);
+
+    CHECK(log.size() == 2);
+    CHECK(log.size() == 2 && log[0] == std::string(100, 'x'));
+    CHECK(log.size() == 2 && log[1] == "other");
+    CHECK(other == self);
+}
+
+//
+// Fast-forwarding through the stopped state
+//
+
+// Waits for a level 1 interrupt which increments D1
+//
+//     1000: stop    #$2000
+//     1004: bra.s   $1000
+//     1100: addq.l  #1,d1
+//     1102: rte
+static const std::vector<u16> stopProgram = {
+
+    0x4E72, 0x2000, 0x60FA
+};
+
+static void raiseIrq(UnitCPU &cpu, i64 cycle)
+{
+    // Raise IPL 1 until the interrupt is being processed
+    int lower = cpu.scheduler.add([&cpu]() { cpu.setIPL(0); });
+    int raise = cpu.scheduler.add([&cpu, lower]() {
+        cpu.setIPL(1);
+        cpu.scheduler.schedule(lower, cpu.getClock() + 30);
+    });
+    cpu.scheduler.schedule(raise, cycle);
+}
+
+static void testFastForward()
+{
+    UnitCPU cpu(stopProgram), ref(stopProgram);
+
+    for (auto *c : { &cpu, &ref }) {
+
+        c->poke16(0x64, 0x0000);    // Level 1 autovector
+        c->poke16(0x66, 0x1100);
+        c->poke16(0x1100, 0x5281);
+        c->poke16(0x1102, 0x4E73);
+        raiseIrq(*c, 5000);
+    }
+
+    cpu.setFastForward(true);
+    auto stats = cpu.run(20000);
+    auto refStats = ref.run(20000);
+
+    // Skipping the stopped state doesn't change the outcome
+    CHECK(cpu.getD(1) > 0);
+    CHECK(cpu.getD(1) == ref.getD(1));
+    CHECK(cpu.getClock() == ref.getClock());
+    CHECK(cpu.getPC0() == ref.getPC0());
+    CHECK(stats.instructions == refStats.instructions);
+}
+
+//
+// Skipping idle loops
+//
+
+// Waits for a memory cell to become non-zero and counts in D1
+//
+//     1000: tst.w   $2000
+//     1006: beq.s   $1000
+//     1008: addq.l  #1,d1
+//     100a: clr.w   $2000
+//     1010: bra.s   $1000
+static const std::vector<u16> idleProgram = {
+
+    0x4A79, 0x0000, 0x2000, 0x67F8, 0x5281, 0x4279, 0x0000, 0x2000, 0x60EE
+};
+
+static void testIdleDetection()
+{
+    UnitCPU cpu(idleProgram), ref(idleProgram);
+
+    for (auto *c : { &cpu, &ref }) {
+
+        int id = c->scheduler.add([c]() { c->poke16(0x2000, 1); });
+        c->scheduler.schedule(id, 50000);
+    }
+
+    // The detection can't be enabled if it is not compiled in
+    cpu.setIdleDetection(true);
+    CHECK(cpu.getIdleDetection() == DETECT_IDLE_LOOPS);
+
+    auto stats = cpu.run(100000);
+    auto refStats = ref.run(100000);
+
+    // The loop is left in the same cycle as without skipping
+    CHECK(cpu.getD(1) == 1);
+    CHECK(cpu.getD(1) == ref.getD(1));
+    CHECK(cpu.getClock() == ref.getClock());
+    CHECK(cpu.getPC0() == ref.getPC0());
+    if constexpr (DETECT_IDLE_LOOPS) {
+        CHECK(stats.instructions < refStats.instructions / 10);
+    } else {
+        CHECK(stats.instructions == refStats.instructions);
+    }
+
+    // Loops polling mapped memory are not skipped
+    UnitCPU mapped(idleProgram);
+    int id = mapped.scheduler.add([&mapped]() { mapped.poke16(0x2000, 1); });
+    mapped.scheduler.schedule(id, 50000);
+    mapped.memoryMap.mapRam(0x0000, 0xFFFF, mapped.mem);
+    mapped.setIdleDetection(true);
+    stats = mapped.run(100000);
+
+    CHECK(mapped.getD(1) == ref.getD(1));
+    CHECK(mapped.getClock() == ref.getClock());
+    CHECK(stats.instructions == refStats.instructions);
+}
+
+//
+// Accelerating DBF loops
+//
+
+// Copies 100 long words from $4000 to $6000 and counts the passes at $7000
+//
+//     1000: lea     $4000,a0
+//     1006: lea     $6000,a1
+//     100c: move.w  #99,d0
+//     1010: move.l  (a0)+,(a1)+
+//     1012: dbf     d0,$1010
+//     1016: addq.l  #1,$7000
+//     101c: bra.s   $1000
+static const std::vector<u16> copyProgram = {
+
+    0x41F9, 0x0000, 0x4000, 0x43F9, 0x0000, 0x6000, 0x303C, 0x0063,
+    0x22D8, 0x51C8, 0xFFFC, 0x52B9, 0x0000, 0x7000, 0x60E2
+};
+
+static void testLoopAcceleration()
+{
+    UnitCPU cpu(copyProgram), ref(copyProgram);
+
+    for (auto *c : { &cpu, &ref }) {
+
+        for (u32 i = 0; i < 400; i += 2) c->poke16(0x4000 + i, u16(i * 0x101));
+        c->memoryMap.mapRam(0x0000, 0xFFFF, c->mem);
+    }
+
+    cpu.setLoopAcceleration(true);
+    auto stats = cpu.run(100000);
+    auto refStats = ref.run(100000);
+
+    // The loop produces the same results in the same number of cycles
+    CHECK(cpu.peek16(0x7002) > 0);
+    CHECK(cpu.getClock() == ref.getClock());
+    CHECK(cpu.getPC0() == ref.getPC0());
+    for (int i = 0; i < 8; i++) CHECK(cpu.getD(i) == ref.getD(i) && cpu.getA(i) == ref.getA(i));
+    CHECK(memcmp(cpu.mem, ref.mem, sizeof(cpu.mem)) == 0);
+    CHECK(stats.instructions < refStats.instructions);
+}
+
+//
+// Saving and restoring snapshots
+//
+
+static void testSnapshot()
+{
+    UnitCPU cpu;
+    int fired = 0;
+
+    int id = cpu.scheduler.add([&]() { fired++; });
+    cpu.scheduler.schedule(id, 5000);
+    cpu.run(1000);
+
+    std::vector<u8> state(cpu.stateSize());
+    CHECK(cpu.saveState(state) == cpu.stateSize());
+
+    // Run past the event and travel back
+    u32 d0 = cpu.getD(0);
+    i64 clock = cpu.getClock();
+    cpu.run(10000);
+    CHECK(fired == 1);
+
+    cpu.loadState(state);
+    CHECK(cpu.getD(0) == d0);
+    CHECK(cpu.getClock() == clock);
+    CHECK(cpu.getPC0() >= 0x1002 && cpu.getPC0() <= 0x100A);
+    CHECK(cpu.scheduler.isPending(id));
+    CHECK(cpu.scheduler.getTrigger(id) == 5000);
+
+    // The restored CPU continues exactly as before
+    UnitCPU ref;
+    ref.run(1000);
+    ref.run(10000);
+    cpu.run(10000);
+    CHECK(fired == 2);
+    CHECK(cpu.getClock() == ref.getClock());
+    CHECK(cpu.getD(0) == ref.getD(0));
+
+    // A snapshot can be loaded into another instance with the same event sources
+    UnitCPU other;
+    int otherFired = 0;
+    int otherId = other.scheduler.add([&]() { otherFired++; });
+    other.loadState(state);
+    other.run(10000);
+    CHECK(otherFired == 1);
+    CHECK(other.getClock() == ref.getClock());
+    CHECK(other.getD(0) == ref.getD(0));
+
+    // Internal events are neither saved nor restored
+    int internal = other.scheduler.add([]() { }, true);
+    other.scheduler.schedule(internal, 123456);
+    CHECK(other.stateSize() == cpu.stateSize());
+    other.loadState(state);
+    CHECK(other.scheduler.getTrigger(otherId) == 5000);
+    CHECK(other.scheduler.getTrigger(internal) == 123456);
+}
+
+static void testSnapshotErrors()
+{
+    UnitCPU cpu;
+    cpu.scheduler.add([]() { });
+
+    std::vector<u8> state(cpu.stateSize());
+    cpu.saveState(state);
+
+    // Buffers which are too small
+    std::vector<u8> small(cpu.stateSize() - 1);
+    CHECK_THROWS(cpu.saveState(small));
+    CHECK_THROWS(cpu.loadState(std::span<const u8>(state.data(), state.size() - 1)));
+    CHECK_THROWS(cpu.loadState(std::span<const u8>(state.data(), 4)));
+
+    // Corrupted headers
+    auto corrupted = state;
+    corrupted[0] ^= 0xFF;
+    CHECK_THROWS(cpu.loadState(corrupted));
+    corrupted = state;
+    corrupted[4] ^= 0xFF;
+    CHECK_THROWS(cpu.loadState(corrupted));
+
+    // A CPU with a different number of event sources
+    UnitCPU other;
+    CHECK_THROWS(other.loadState(state));
+
+    // The original snapshot is still accepted
+    cpu.loadState(state);
+}
+
+//
+// Running CPUs in parallel
+//
+
+static void testBatchRunner()
+{
+    BatchRunner runner(2);
+
+    for (int i = 0; i < 4; i++) runner.add(std::make_unique<UnitCPU>());
+    CHECK(runner.cpus() == 4);
+    CHECK(runner.threads() == 2);
+
+    // Slicing doesn't change the outcome
+    auto stats = runner.run(100000, 1000);
+
+    UnitCPU ref;
+    auto refStats = ref.run(100000);
+
+    for (int i = 0; i < runner.cpus(); i++) {
+
+        auto &cpu = runner.cpu(i);
+        CHECK(cpu.getClock() == ref.getClock());
+        CHECK(cpu.getD(0) == ref.getD(0));
+    }
+    CHECK(stats.instructions == 4 * refStats.instructions);
+    CHECK(stats.cycles == 4 * refStats.cycles);
+
+    // Consecutive batches continue where the previous one has stopped
+    runner.run(50000, 7000);
+    ref.run(50000);
+    for (int i = 0; i < runner.cpus(); i++) CHECK(runner.cpu(i).getD(0) == ref.getD(0));
+}
+
+//
+// Traveling back in time
+//
+
+static void testTimeMachine()
+{
+    UnitCPU cpu;
+    auto &tm = cpu.debugger.timeMachine;
+    int fired = 0, replayed = 0;
+
+    int id = cpu.scheduler.add([&]() { fired++; replayed += tm.isReplaying(); });
+    cpu.scheduler.schedule(id, 5000);
+
+    tm.setInterval(1000);
+    tm.setEnabled(true);
+    cpu.run(10000);
+    CHECK(fired == 1);
+
+    u32 d0 = cpu.getD(0);
+    i64 clock = cpu.getClock();
+
+    // Travel back to a cycle before the event
+    CHECK(tm.seekToCycle(2000));
+
+    UnitCPU ref;
+    ref.executeUntil(2000);
+    CHECK(cpu.getClock() == ref.getClock());
+    CHECK(cpu.getD(0) == ref.getD(0));
+    CHECK(cpu.getPC0() == ref.getPC0());
+    CHECK(cpu.peek16(0x2000) == ref.peek16(0x2000));
+    CHECK(cpu.scheduler.isPending(id));
+    CHECK(cpu.scheduler.getTrigger(id) == 5000);
+
+    // Travel forward again (the event is triggered again while replaying)
+    CHECK(tm.seekToCycle(clock));
+    CHECK(cpu.getClock() == clock);
+    CHECK(cpu.getD(0) == d0);
+    CHECK(fired == 2);
+    CHECK(replayed == 1);
+
+    // Step back by a single instruction
+    i64 step = tm.getStep();
+    CHECK(tm.stepBack());
+    CHECK(tm.getStep() == step - 1);
+    CHECK(cpu.getClock() < clock);
+
+    // Search backwards for the latest breakpoint hit
+    cpu.debugger.breakpoints.setAt(0x1004);
+    CHECK(tm.reverseContinue());
+    CHECK(cpu.getPC0() == 0x1004);
+    cpu.debugger.breakpoints.removeAt(0x1004);
+
+    // Memory is restored without accessing the bus
+    long writes = cpu.busWrites;
+    CHECK(tm.seekToCycle(0));
+    CHECK(cpu.getClock() == 0);
+    CHECK(cpu.peek16(0x2000) == 0);
+    CHECK(cpu.busWrites == writes);
+
+    // Checkpoints don't match if the event sources have changed
+    CHECK(tm.seekToCycle(3000));
+    cpu.scheduler.add([]() { });
+    CHECK_THROWS(tm.seekToCycle(2000));
+}
+
+// A CPU which relies on the default implementations of poke8() and poke16()
+class NoPokeCPU : public UnitCPU {
+
+public:
+
+    void poke8(u32 addr, u8 val) override { Moira::poke8(addr, val); }
+    void poke16(u32 addr, u16 val) override { Moira::poke16(addr, val); }
+};
+
+static void testTimeMachineUnmapped()
+{
+    // Writes which can't be undone cut off the history, but recording continues
+    {   NoPokeCPU cpu;
+        auto &tm = cpu.debugger.timeMachine;
+
+        tm.setInterval(1000);
+        tm.setEnabled(true);
+        cpu.run(10000);
+        CHECK(tm.isEnabled());
+        CHECK(tm.getUnrestorable() > 0);
+        CHECK(!tm.seekToCycle(0));
+        CHECK(cpu.getClock() >= 10000);
+
+        // The history after the latest write is still reachable
+        auto first = tm.firstStep();
+        CHECK(first && *first > 0);
+        CHECK(first && tm.seek(*first));
+        CHECK(cpu.getClock() < 10000);
+    }
+
+    // Writes into mapped pages can be undone without poke8() and poke16()
+    {   NoPokeCPU cpu;
+        auto &tm = cpu.debugger.timeMachine;
+
+        cpu.memoryMap.mapRam(0x2000, 0x2FFF, cpu.mem + 0x2000);
+        tm.setInterval(1000);
+        tm.setEnabled(true);
+        cpu.run(10000);
+        CHECK(tm.getUnrestorable() == 0);
+        CHECK(tm.seekToCycle(0));
+        CHECK(cpu.peek16(0x2000) == 0);
+    }
+}
+
+static void testTimeMachineSampler()
+{
+    UnitCPU cpu;
+    auto &tm = cpu.debugger.timeMachine;
+    std::vector<Sample> samples(1000);
+
+    cpu.sampler.setInterval(997);
+    cpu.sampler.setEnabled(true);
+    tm.setInterval(1000);
+    tm.setEnabled(true);
+    cpu.run(20000);
+    size_t count = cpu.sampler.drain(samples);
+    CHECK(count >= 19);
+
+    // Replayed instructions are not sampled again
+    i64 clock = cpu.getClock();
+    CHECK(tm.seekToCycle(2000));
+    CHECK(tm.seekToCycle(clock));
+    CHECK(cpu.sampler.pending() == 0);
+
+    // Sampling continues after the replay
+    cpu.run(20000);
+    CHECK(cpu.sampler.drain(samples) >= 19);
+}
+
+static const std::vector<u16> callProgram = {
+
+    0x4EB9, 0x0000, 0x1100, 0x6100, 0x01F8, 0x4E40, 0x60F2
+};
+
+static void testTimeMachineAnalysis()
+{
+    UnitCPU cpu(callProgram);
+    auto &tm = cpu.debugger.timeMachine;
+    auto &tracer = cpu.debugger.tracer;
+    std::vector<TraceEntry> entries(4096);
+
+    cpu.poke16(0x80, 0x0000);       // Trap #0 vector
+    cpu.poke16(0x82, 0x1300);
+    cpu.poke16(0x1100, 0x4E75);
+    cpu.poke16(0x1200, 0x40E7);
+    cpu.poke16(0x1202, 0x4E77);
+    cpu.poke16(0x1300, 0x4E73);
+
+    auto profiled = [&]() { i64 r = 0; for (auto &it : cpu.profiler.pcHotspots()) r += it.hits; return r; };
+    auto called = [&]() { i64 r = 0; for (auto &it : cpu.callGraph.functions()) r += it.calls; return r; };
+
+    cpu.profiler.setEnabled(true);
+    cpu.callGraph.setEnabled(true);
+    tracer.setEnabled(true);
+    tm.setInterval(1000);
+    tm.setEnabled(true);
+    cpu.run(5000);
+
+    i64 hits = profiled(), calls = called();
+    CHECK(hits > 100 && calls > 10);
+    CHECK(tracer.drain(entries) == size_t(hits));
+
+    // Replayed instructions are not recorded again
+    i64 clock = cpu.getClock();
+    CHECK(tm.seekToCycle(2000));
+    CHECK(tm.seekToCycle(clock));
+    CHECK(profiled() == hits);
+    CHECK(called() == calls);
+    CHECK(tracer.pending() == 0);
+    CHECK(cpu.callGraph.getUnmatched() == 0);
+
+    // Recording continues after the replay
+    cpu.execute();
+    CHECK(profiled() == hits + 1);
+    CHECK(tracer.drain(entries) == 1);
+}
+
+//
+// Profiling instructions
+//
+
+static const Hotspot *find(const std::vector<Hotspot> &table, u32 key)
+{
+    for (auto &it : table) if (it.key == key) return &it;
+    return nullptr;
+}
+
+static void testProfiler()
+{
+    UnitCPU cpu;
+
+    cpu.profiler.setEnabled(true);
+    cpu.run(10000);
+
+    auto pcs = cpu.profiler.pcHotspots();
+    auto opcodes = cpu.profiler.opcodeHotspots();
+    CHECK(pcs.size() == 4);
+    CHECK(opcodes.size() == 4);
+
+    auto *moveq = find(pcs, 0x1000);
+    auto *addq = find(pcs, 0x1002);
+    auto *move = find(pcs, 0x1004);
+    auto *bra = find(pcs, 0x100A);
+    CHECK(moveq && addq && move && bra);
+    if (!moveq || !addq || !move || !bra) return;
+
+    // Each loop instruction is executed once per iteration
+    CHECK(moveq->hits == 1);
+    CHECK(addq->hits == i64(cpu.getD(0)));
+    CHECK(addq->hits - move->hits <= 1 && addq->hits - move->hits >= 0);
+    CHECK(move->hits - bra->hits <= 1 && move->hits - bra->hits >= 0);
+
+    // The cycles are attributed to the right instructions
+    CHECK(moveq->cycles == 4);
+    CHECK(addq->cycles == 8 * addq->hits);
+    CHECK(move->cycles == 16 * move->hits);
+    CHECK(bra->cycles == 10 * bra->hits);
+    CHECK(moveq->cycles + addq->cycles + move->cycles + bra->cycles == cpu.getClock());
+
+    // Opcodes are counted in the same way
+    auto *op = find(opcodes, 0x5280);
+    CHECK(op && op->hits == addq->hits);
+
+    // The table is sorted by the number of consumed cycles
+    auto top = cpu.profiler.pcHotspots(1);
+    CHECK(top.size() == 1 && top[0].key == 0x1004);
+
+    cpu.profiler.clear();
+    CHECK(cpu.profiler.pcHotspots().empty());
+}
+
+//
+// Sampling the program counter
+//
+
+static void testSampler()
+{
+    UnitCPU cpu;
+
+    cpu.sampler.setInterval(997);
+    cpu.sampler.setEnabled(true);
+    cpu.run(200000);
+
+    std::vector<Sample> samples(1000);
+    samples.resize(cpu.sampler.drain(samples));
+    CHECK(samples.size() >= 195 && samples.size() <= 201);
+    CHECK(cpu.sampler.pending() == 0);
+    CHECK(cpu.sampler.getDropped() == 0);
+
+    // Samples are taken on a fixed grid and refer to the executing instruction
+    long count[3] = { };
+    for (size_t i = 0; i < samples.size(); i++) {
+
+        auto &s = samples[i];
+        CHECK(s.clock >= 997 * i64(i + 1) && s.clock < 997 * i64(i + 1) + 16);
+        CHECK(s.opcode == cpu.peek16(s.pc));
+        CHECK(s.supervisor);
+
+        if (s.pc == 0x1002) count[0]++;
+        if (s.pc == 0x1004) count[1]++;
+        if (s.pc == 0x100A) count[2]++;
+    }
+
+    // The number of samples is proportional to the duration (8, 16, 10 cycles)
+    CHECK(count[0] + count[1] + count[2] == long(samples.size()));
+    CHECK(count[1] > count[2] && count[2] > count[0]);
+
+    // The slow path is only taken shortly before a sample
+    UnitCPU fast;
+    fast.sampler.setInterval(997);
+    fast.sampler.setEnabled(true);
+    fast.executeUntil(997 * 10 - 500);
+    CHECK(!fast.isSampling());
+    fast.executeUntil(997 * 10 - 100);
+    CHECK(fast.isSampling());
+    fast.executeUntil(997 * 10 + 100);
+    CHECK(!fast.isSampling());
+
+    // Intervals shorter than the lead time keep the slow path enabled
+    fast.sampler.setInterval(37);
+    fast.run(3700);
+    samples.resize(1000);
+    samples.resize(fast.sampler.drain(samples));
+    CHECK(samples.size() >= 100);
+    for (auto &s : samples) CHECK(s.opcode == fast.peek16(s.pc));
+    CHECK(fast.isSampling());
+
+    // The lead time covers the longest instruction
+    //
+    //     1000: moveq   #-1,d0
+    //     1002: divs.w  $3000,d0
+    //     1008: bra.s   $1000
+    UnitCPU div({ 0x70FF, 0x81F9, 0x0000, 0x3000, 0x60F6 });
+    div.poke16(0x3000, 2);
+    div.execute();
+    i64 start = div.getClock();
+    div.execute();
+    CHECK(div.getClock() - start <= Sampler::maxInstrCycles);
+    CHECK(div.getClock() - start > Sampler::maxInstrCycles - 16);
+
+    div.sampler.setInterval(997);
+    div.sampler.setEnabled(true);
+    div.run(100000);
+    samples.resize(1000);
+    samples.resize(div.sampler.drain(samples));
+    CHECK(samples.size() >= 99);
+    for (auto &s : samples) CHECK(s.opcode == div.peek16(s.pc));
+
+    // Snapshots can be exchanged between CPUs with and without a sampler
+    std::vector<u8> state(cpu.stateSize());
+    cpu.saveState(state);
+    UnitCPU other;
+    CHECK(other.stateSize() == cpu.stateSize());
+    other.loadState(state);
+    CHECK(other.getClock() == cpu.getClock());
+    CHECK(!other.isSampling());
+
+    // The sampling grid continues at the restored clock
+    fast.loadState(state);
+    fast.sampler.setInterval(997);
+    fast.sampler.drain(samples);
+    fast.run(2000);
+    samples.resize(fast.sampler.drain(samples));
+    CHECK(samples.size() == 2);
+    for (auto &s : samples) CHECK(s.clock > cpu.getClock());
+
+    // No samples are taken while disabled
+    cpu.sampler.setEnabled(false);
+    cpu.run(10000);
+    CHECK(cpu.sampler.pending() == 0);
+}
+
+//
+// Recording the call graph
+//
+
+// Calls a subroutine via JSR, BSR, and TRAP and returns via RTS, RTR, and RTE
+//
+//     1000: jsr     $1100
+//     1006: bsr.w   $1200
+//     100a: trap    #0
+//     100c: bra.s   $1000
+//     1100: rts
+//     1200: move    sr,-(sp)
+//     1202: rtr
+//     1300: rte
+static const FunctionStats *find(const std::vector<FunctionStats> &table, u32 addr)
+{
+    for (auto &it : table) if (it.addr == addr) return &it;
+    return nullptr;
+}
+
+static void testCallGraph()
+{
+    UnitCPU cpu(callProgram);
+
+    cpu.poke16(0x80, 0x0000);       // Trap #0 vector
+    cpu.poke16(0x82, 0x1300);
+    cpu.poke16(0x1100, 0x4E75);
+    cpu.poke16(0x1200, 0x40E7);
+    cpu.poke16(0x1202, 0x4E77);
+    cpu.poke16(0x1300, 0x4E73);
+
+    cpu.callGraph.setEnabled(true);
+    cpu.run(100000);
+
+    // All returns match their calls
+    CHECK(cpu.callGraph.getUnmatched() == 0);
+    CHECK(cpu.callGraph.getDiscarded() == 0);
+    CHECK(cpu.callGraph.depth() <= 1);
+
+    auto functions = cpu.callGraph.functions();
+    auto *jsr = find(functions, 0x1100);
+    auto *bsr = find(functions, 0x1200);
+    auto *trap = find(functions, 0x1300);
+    CHECK(jsr && bsr && trap);
+    if (!jsr || !bsr || !trap) return;
+
+    CHECK(jsr->vector == 0 && bsr->vector == 0 && trap->vector == 32);
+    CHECK(jsr->calls > 100);
+    CHECK(jsr->calls - bsr->calls <= 1 && jsr->calls - bsr->calls >= 0);
+    CHECK(bsr->calls - trap->calls <= 1 && bsr->calls - trap->calls >= 0);
+
+    // Leaf functions don't have callees
+    CHECK(jsr->self == jsr->total);
+    CHECK(bsr->self == bsr->total);
+    CHECK(trap->self == trap->total);
+}
+
+//
+// Tracing instructions
+//
+
+static void testTracer()
+{
+    UnitCPU cpu;
+    auto &tracer = cpu.debugger.tracer;
+    std::vector<TraceEntry> expected;
+
+    tracer.setEnabled(true);
+
+    for (int i = 0; i < 200; i++) {
+
+        TraceEntry e = { .clock = cpu.getClock(), .pc = cpu.getPC0(), .sr = cpu.getSR() };
+        for (int j = 0; j < 8; j++) { e.r[j] = cpu.getD(j); e.r[j + 8] = cpu.getA(j); }
+        expected.push_back(e);
+
+        cpu.execute();
+    }
+
+    // The decoded entries reproduce the register contents
+    std::vector<TraceEntry> entries(256);
+    entries.resize(tracer.drain(entries));
+    CHECK(entries.size() == expected.size());
+
+    for (size_t i = 0; i < entries.size() && i < expected.size(); i++) {
+
+        auto &e = entries[i];
+        CHECK(e.clock == expected[i].clock);
+        CHECK(e.pc == expected[i].pc);
+        CHECK(e.sr == expected[i].sr);
+        CHECK(memcmp(e.r, expected[i].r, sizeof(e.r)) == 0);
+        CHECK(e.keyFrame == (i == 0));
+    }
+
+    // Entries are dropped if the buffer is full
+    tracer.setCapacity(256);
+    for (int i = 0; i < 200; i++) cpu.execute();
+    CHECK(tracer.getDropped() > 0);
+    entries.resize(256);
+    tracer.drain(entries);
+
+    // The next entry after a drop is a key frame
+    u32 d0 = cpu.getD(0), pc = cpu.getPC0();
+    cpu.execute();
+    entries.resize(tracer.drain(entries));
+    CHECK(entries.size() == 1);
+    CHECK(entries.size() == 1 && entries[0].keyFrame);
+    CHECK(entries.size() == 1 && entries[0].pc == pc && entries[0].r[0] == d0);
+}
+
+//
+// Managing breakpoints
+//
+
+static void testGuards()
+{
+    UnitCPU cpu;
+    auto &bp = cpu.debugger.breakpoints;
+
+    // Look up guards in a large set
+    for (u32 i = 0; i < 1000; i++) bp.setAt(0x100000 + 4 * i);
+    CHECK(bp.elements() == 1000);
+    CHECK(bp.isSetAt(0x100000));
+    CHECK(bp.isSetAt(0x100000 + 4 * 999));
+    CHECK(!bp.isSetAt(0x100002));
+    CHECK(!bp.isSetAt(0x1000));
+    CHECK(bp.guardAt(0x100800) && bp.guardAt(0x100800)->addr == 0x100800);
+
+    bp.removeAt(0x100800);
+    CHECK(bp.elements() == 999);
+    CHECK(!bp.isSetAt(0x100800));
+    CHECK(bp.isSetAt(0x100804));
+    CHECK(bp.guardAddr(0) == 0x100000);
+
+    // Removing guards one by one keeps the others in order and in the table
+    for (u32 i = 0; i < 1000; i += 2) bp.removeAt(0x100000 + 4 * i);
+    CHECK(bp.elements() == 500);
+    for (u32 i = 0; i < 500; i++) {
+
+        u32 addr = 0x100000 + 4 * (2 * i + 1);
+        CHECK(bp.guardAddr(i) == addr);
+        CHECK(bp.guardAt(addr) == bp.guardNr(i));
+        CHECK(!bp.isSetAt(addr - 4));
+    }
+
+    // Replacing a guard moves it to the new address
+    bp.replace(0, 0x200000);
+    CHECK(bp.isSetAt(0x200000));
+    CHECK(!bp.isSetAt(0x100004));
+    CHECK(bp.guardAt(0x200000) == bp.guardNr(0));
+
+    // None of the guards matches the program
+    cpu.run(10000);
+    CHECK(cpu.breakpoints == 0);
+
+    // A matching breakpoint stops the CPU
+    bp.setAt(0x1004);
+    auto stats = cpu.run(10000);
+    CHECK(cpu.breakpoints == 1);
+    CHECK(cpu.getPC0() == 0x1004);
+    CHECK(stats.cycles < 10000);
+
+    // Ignored and disabled guards don't stop the CPU
+    bp.ignore(bp.elements() - 1, 3);
+    u32 d0 = cpu.getD(0);
+    cpu.run(10000);
+    CHECK(cpu.breakpoints == 2);
+    CHECK(cpu.getD(0) == d0 + 4);
+
+    bp.disableAt(0x1004);
+    cpu.run(10000);
+    CHECK(cpu.breakpoints == 2);
+
+    bp.removeAll();
+    CHECK(bp.elements() == 0);
+    CHECK(!bp.isSetAt(0x100000));
+
+    // Guards can be added again after the presence bitmap has been freed
+    bp.setAt(0x1004);
+    cpu.run(10000);
+    CHECK(cpu.breakpoints == 3);
+}
+
+//
+// Watching address ranges
+//
+
+static void testWatchRanges()
+{
+    // A write range stops the CPU at the first write
+    {   UnitCPU cpu;
+        auto &wp = cpu.debugger.watchpoints;
+
+        wp.setRange(0x1F00, 0x2000, false, true);
+        CHECK(wp.rangeCount() == 1);
+        cpu.run(10000);
+        CHECK(cpu.watchpoints == 1);
+        CHECK(cpu.getD(0) == 1);
+        CHECK(wp.rangeHit && wp.rangeHit->first == 0x1F00);
+        CHECK(wp.hit && wp.hit->addr == 0x1F00 && wp.hit->hits == 1);
+    }
+
+    // A range hit replaces the previous single-address hit
+    {   UnitCPU cpu;
+        auto &wp = cpu.debugger.watchpoints;
+
+        wp.setAt(0x2000);
+        cpu.run(10000);
+        CHECK(wp.hit && wp.hit->addr == 0x2000 && !wp.rangeHit);
+        wp.removeAt(0x2000);
+        wp.setRange(0x1F00, 0x2001, false, true);
+        cpu.run(10000);
+        CHECK(wp.rangeHit && wp.rangeHit->first == 0x1F00);
+        CHECK(wp.hit && wp.hit->addr == 0x1F00);
+    }
+
+    // A read range ignores writes
+    {   UnitCPU cpu;
+        auto &wp = cpu.debugger.watchpoints;
+
+        wp.setRange(0x2000, 0x2FFF, true, false);
+        cpu.run(10000);
+        CHECK(cpu.watchpoints == 0);
+        CHECK(wp.rangeNr(0) && wp.rangeNr(0)->hits == 0);
+    }
+
+    // Ignore counters and disabled ranges
+    {   UnitCPU cpu;
+        auto &wp = cpu.debugger.watchpoints;
+
+        wp.setRange(0x2001, 0x2001);
+        wp.ignoreRange(0, 3);
+        cpu.run(10000);
+        CHECK(cpu.watchpoints == 1);
+        CHECK(cpu.getD(0) == 4);
+        CHECK(wp.rangeNr(0) && wp.rangeNr(0)->hits == 4);
+
+        wp.setRangeEnable(0, false);
+        cpu.run(10000);
+        CHECK(cpu.watchpoints == 1);
+
+        wp.removeRange(0);
+        CHECK(wp.rangeCount() == 0);
+
+        // Ranges can be added again after the presence bitmap has been freed
+        wp.setRange(0x2000, 0x2001);
+        cpu.run(10000);
+        CHECK(cpu.watchpoints == 2);
+    }
+}
+
+//
+// Evaluating conditions
+//
+
+static void testConditions()
+{
+    UnitCPU cpu;
+
+    cpu.setD(0, 0x1234);
+    cpu.setA(0, 0x4000);
+    cpu.poke16(0x4000, 17);
+    cpu.poke16(0x4002, 0xABCD);
+
+    auto eval = [&](const char *expr, i64 hits = 1) { return Condition(cpu, expr).eval(hits); };
+
+    // Registers and memory
+    CHECK(eval("D0 == 0x1234 && (A0) > 16"));
+    CHECK(!eval("D0 == 0x1234 && (A0) > 17"));
+    CHECK(eval("(a0).l == $0011ABCD"));
+    CHECK(eval("2(A0) == 0xABCD"));
+    CHECK(eval("3(a0).b == 0xCD"));
+    CHECK(eval("(A0 + 2).b == 0xAB"));
+    CHECK(eval("(A0+2) == 0x4002"));
+    CHECK(eval("D0.b == 0x34"));
+    CHECK(eval("S"));
+    CHECK(eval("SR & 0x2000"));
+    CHECK(eval("PC == PC"));
+
+    // Mapped memory (addresses are truncated to 24 bits)
+    u8 page[0x1000] = { 0x55, 0xAA, 0x12, 0x34 };
+    cpu.memoryMap.mapRom(0x5000, 0x5FFF, page);
+    cpu.setA(1, 0xFF005000);
+    CHECK(eval("(A1) == 0x55AA"));
+    CHECK(eval("1(A1).b == 0xAA"));
+    CHECK(eval("(A1).l == 0x55AA1234"));
+
+    // Operators
+    CHECK(eval("1 + 2 * 3 == 7"));
+    CHECK(eval("(1 + 2) * 3 == 9"));
+    CHECK(eval("1 << 4 | 1 == 17"));
+    CHECK(eval("-1 < 0"));
+    CHECK(eval("!0 && ~0 == -1"));
+    CHECK(eval("5 / 0 == 0"));
+    CHECK(eval("D0 >= 0x1234 && D0 <= 0x1234 && D0 != 0"));
+    CHECK(eval("1 || 0"));
+    CHECK(!eval("0 | 0"));
+
+    // Counters
+    CHECK(eval("hits % 3 == 0", 6));
+    CHECK(!eval("hits % 3 == 0", 7));
+
+    // Syntax errors
+    for (auto expr : { "", "D0 ==", "(D0", "D8", "foo", "0x", "12a", "D0.q", "1 = 1", "D0 !! D0" }) {
+        CHECK_THROWS(Condition(cpu, expr));
+    }
+    try {
+        Condition(cpu, "D0 == foo");
+    } catch (const std::runtime_error &e) {
+        CHECK(std::string(e.what()).find("position 6") != std::string::npos);
+    }
+}
+
+static void testConditionalBreakpoints()
+{
+    UnitCPU cpu;
+    auto &bp = cpu.debugger.breakpoints;
+
+    bp.setAt(0x1004);
+    bp.setConditionAt(0x1004, "D0 == 5");
+    CHECK_THROWS(bp.setConditionAt(0x1004, "D0 =="));
+
+    cpu.run(10000);
+    CHECK(cpu.breakpoints == 1);
+    CHECK(cpu.getD(0) == 5);
+    CHECK(cpu.getPC0() == 0x1004);
+
+    // The hit counter is available in conditions
+    bp.setConditionAt(0x1004, "hits == 10");
+    cpu.run(10000);
+    CHECK(cpu.breakpoints == 2);
+
+    bp.removeConditionAt(0x1004);
+    cpu.run(10000);
+    CHECK(cpu.breakpoints == 3);
+
+    // Removing guards releases their conditions
+    bp.setAt(0x100000);
+    bp.setConditionAt(0x100000, "D0 == 0");
+    std::weak_ptr<Condition> condition = bp.guardAt(0x100000)->condition;
+    bp.removeAt(0x1004);
+    bp.removeAt(0x100000);
+    CHECK(condition.expired());
+}
+
+//
+// Recording code coverage
+//
+
+static void testCoverage()
+{
+    UnitCPU cpu;
+
+    // Nothing is recorded while disabled
+    cpu.run(1000);
+    CHECK(cpu.coverage.snapshot().pcCount() == 0);
+
+    cpu.coverage.setEnabled(true);
+    cpu.debugger.jump(0x1000);
+    cpu.run(1000);
+    auto map = cpu.coverage.snapshot();
+
+    CHECK(map.coversPC(0x1000));
+    CHECK(map.coversPC(0x1002));
+    CHECK(map.coversPC(0x1004));
+    CHECK(map.coversPC(0x100A));
+    CHECK(!map.coversPC(0x1006));
+    CHECK(map.coversOpcode(0x5280));
+    CHECK(!map.coversOpcode(0x4E71));
+    CHECK(map.pcCount() == 4);
+    CHECK(map.opcodeCount() == 4);
+    CHECK((map.addresses() == std::vector<u32> { 0x1000, 0x1002, 0x1004, 0x100A }));
+
+    // Comparing maps
+    CoverageMap empty;
+    CHECK(cpu.coverage.hasNew(empty));
+    CHECK(!cpu.coverage.hasNew(map));
+    CHECK(map.hasNew(empty));
+    CHECK(!empty.hasNew(map));
+    CoverageMap diff;
+    map.diff(empty, diff);
+    CHECK(diff.pcCount() == 4);
+    cpu.coverage.diff(map, diff);
+    CHECK(diff.pcCount() == 0);
+
+    // Merging maps
+    cpu.coverage.clear();
+    CHECK(cpu.coverage.snapshot().pcCount() == 0);
+    cpu.coverage.merge(map);
+    CHECK(cpu.coverage.snapshot().pcCount() == 4);
+    empty.merge(map);
+    CHECK(empty.opcodeCount() == 4);
+}
+
+//
+// Hooking instructions
+//
+
+static void testHooks()
+{
+    UnitCPU cpu;
+
+    // No delegates are called for unhooked instructions
+    cpu.run(1000);
+    CHECK(cpu.will.empty() && cpu.did.empty());
+
+    // Hook a single instruction
+    cpu.hookInstr(ADDQ, HOOK_WILL_EXECUTE | HOOK_DID_EXECUTE);
+    CHECK(cpu.getInstrHook(ADDQ) == (HOOK_WILL_EXECUTE | HOOK_DID_EXECUTE));
+
+    u32 d0 = cpu.getD(0);
+    cpu.run(1000);
+    CHECK(!cpu.will.empty());
+    CHECK(cpu.will.size() == cpu.getD(0) - d0);
+    CHECK(cpu.did.size() == cpu.will.size());
+    CHECK(!cpu.will.empty() && cpu.will[0] == "execAddqDn");
+
+    // Hook a single opcode
+    cpu.removeAllHooks();
+    cpu.will.clear();
+    cpu.did.clear();
+    cpu.hookOpcode(0x33C0, HOOK_DID_EXECUTE);
+    CHECK(cpu.getOpcodeHook(0x33C0) == HOOK_DID_EXECUTE);
+    cpu.run(1000);
+    CHECK(cpu.will.empty());
+    CHECK(!cpu.did.empty());
+
+    // Remove all hooks
+    cpu.removeAllHooks();
+    cpu.did.clear();
+    cpu.run(1000);
+    CHECK(cpu.will.empty() && cpu.did.empty());
+}
+
+static void testLoopModeHooks()
+{
+    // Clears ten words in the 68010 loop mode
+    //
+    //     1000: lea     $2000.w,a0
+    //     1004: moveq   #9,d1
+    //     1006: clr.w   (a0)+
+    //     1008: dbf     d1,$1006
+    //     100c: bra.s   $100c
+    UnitCPU cpu({ 0x41F8, 0x2000, 0x7209, 0x4258, 0x51C9, 0xFFFC, 0x60FE });
+    cpu.setModel(M68010);
+    cpu.reset();
+
+    // Hooked instructions call the delegates in loop mode, too
+    cpu.hookInstr(CLR, HOOK_WILL_EXECUTE | HOOK_DID_EXECUTE);
+    cpu.hookInstr(DBF, HOOK_DID_EXECUTE);
+    cpu.run(1000);
+    CHECK(cpu.getA(0) == 0x2014);
+    CHECK(cpu.will.size() == 10);
+    CHECK(cpu.did.size() == 20);
+    CHECK(!cpu.will.empty() && cpu.will.back() == "execClr");
+
+    // The loop mode is not affected once the hooks are removed
+    cpu.removeAllHooks();
+    cpu.will.clear();
+    cpu.did.clear();
+    cpu.debugger.jump(0x1000);
+    cpu.run(1000);
+    CHECK(cpu.getA(0) == 0x2014);
+    CHECK(cpu.will.empty() && cpu.did.empty());
+}
+
+static void testDefaultHooks()
+{
+    // STOP calls willExecute() by default, also if it is hooked at runtime
+    for (bool hooked : { false, true }) {
+
+        UnitCPU cpu({ 0x4E72, 0x2700 });
+        if (hooked) cpu.hookInstr(STOP, HOOK_WILL_EXECUTE);
+
+        cpu.execute();
+        cpu.execute();
+        CHECK(cpu.will.size() == 1);
+        CHECK(cpu.will.size() == 1 && cpu.will[0] == "execStop");
+    }
+}
+
+//
+// Caching basic blocks
+//
+
+static void testBlockCache()
+{
+    UnitCPU cpu, ref;
+
+    // Code in ROM is cached and executed as without the cache
+    cpu.memoryMap.mapRom(0x1000, 0x1FFF, cpu.mem + 0x1000);
+    cpu.memoryMap.mapRam(0x2000, 0x2FFF, cpu.mem + 0x2000);
+    cpu.blockCache.setEnabled(true);
+
+    auto stats = cpu.run(10000);
+    auto refStats = ref.run(10000);
+    CHECK(stats.instructions == refStats.instructions);
+    CHECK(cpu.getClock() == ref.getClock());
+    CHECK(cpu.getD(0) == ref.getD(0));
+    CHECK(cpu.peek16(0x2000) == ref.peek16(0x2000));
+    CHECK(cpu.blockCache.blockCount() == 1);
+    CHECK(cpu.blockCache.blockSizeAt(0x1002) == 3);
+
+    // A changed opcode is detected (addq.l #1,d0 becomes addq.l #2,d0)
+    cpu.mem[0x1002] = ref.mem[0x1002] = 0x54;
+    cpu.run(10000);
+    ref.run(10000);
+    CHECK(cpu.getClock() == ref.getClock());
+    CHECK(cpu.getD(0) == ref.getD(0));
+
+    // Cached instructions are hooked, too
+    cpu.hookInstr(ADDQ, HOOK_WILL_EXECUTE);
+    cpu.run(1000);
+    CHECK(!cpu.will.empty());
+    cpu.removeAllHooks();
+
+    // Changing the memory map discards all blocks
+    cpu.memoryMap.unmap(0x1000, 0x1FFF);
+    cpu.run(1000);
+    CHECK(cpu.blockCache.blockCount() == 0);
+
+    // Code in RAM is not cached
+    UnitCPU ram;
+    ram.memoryMap.mapRam(0x0000, 0xFFFF, ram.mem);
+    ram.blockCache.setEnabled(true);
+    ram.run(1000);
+    CHECK(ram.blockCache.blockCount() == 0);
+}
+
+int main(int argc, char **argv)
+{
+    testRun();
+    testJumpTables();
+    testJumpTableEntries();
+    testMemoryMap();
+    testLongAccess();
+    testAccuracy();
+    testScheduler();
+    testSchedulerCallbacks();
+    testFastForward();
+    testIdleDetection();
+    testLoopAcceleration();
+    testSnapshot();
+    testSnapshotErrors();
+    testBatchRunner();
+    testTimeMachine();
+    testTimeMachineUnmapped();
+    testTimeMachineSampler();
+    testTimeMachineAnalysis();
+    testProfiler();
+    testSampler();
+    testCallGraph();
+    testTracer();
+    testGuards();
+    testWatchRanges();
+    testConditions();
+    testConditionalBreakpoints();
+    testCoverage();
+    testHooks();
+    testLoopModeHooks();
+    testDefaultHooks();
+    testBlockCache();
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -24,6 +24,15 @@ static constexpr bool PROFILE_CPU = true;
 // Set to true to measure the disassembler speed
 static constexpr bool PROFILE_DASM = false;
 
+// Set to true to measure the time needed to create and configure a CPU
+static constexpr bool PROFILE_STARTUP = false;
+
+// Set to true to compare the speed of fast and precise timing mode
+static constexpr bool PROFILE_TIMING = false;
+
+// Set to true to measure the overhead of the sampling profiler
+static constexpr bool PROFILE_SAMPLER = false;
+
 // Change to limit the range of executed instructions
 #define doExec(opcode) (opcode >= 0x0000 && opcode <= 0xEFFF)
 
@@ -12,6 +12,11 @@
 
 int main(int argc, char **argv)
 {
+    executable = argv[0];
+
+    // Started by profileStartup()
+    if (argc > 1 && strcmp(argv[1], "--startup") == 0) return startProcess();
+
     moiracpu = new TestCPU();
 
     run();